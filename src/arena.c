@@ -0,0 +1,139 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Copyright (c) 2026 David Jackson
+ */
+
+#include "config.h"
+
+#include "arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#define ARENA_BLOCK_SIZE 16384
+#define ARENA_ALIGNMENT 16
+
+void
+arena_init(struct arena *arena)
+{
+    arena->blocks = NULL;
+}
+
+static struct arena_block
+*arena_block_create(size_t size)
+{
+    struct arena_block *block = malloc(sizeof(struct arena_block) + size);
+    if (block == NULL) {
+        fprintf(stderr, "ERROR: Could not malloc() for arena block\n");
+        abort();
+    }
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+void
+*arena_alloc(struct arena *arena, size_t size)
+{
+    if (arena == NULL) {
+        void *ptr = malloc(size);
+        if (ptr == NULL) {
+            fprintf(stderr, "ERROR: Could not malloc() %zu bytes\n", size);
+            abort();
+        }
+        return ptr;
+    }
+
+    size = (size + ARENA_ALIGNMENT - 1) & ~((size_t) ARENA_ALIGNMENT - 1);
+    struct arena_block *block = arena->blocks;
+    if (block == NULL || block->size - block->used < size) {
+        size_t block_size = ARENA_BLOCK_SIZE;
+        if (size > block_size) {
+            block_size = size;
+        }
+        block = arena_block_create(block_size);
+        block->next = arena->blocks;
+        arena->blocks = block;
+    }
+
+    void *ptr = block->data + block->used;
+    block->used += size;
+    return ptr;
+}
+
+/* Memory from an arena is only given back by arena_reset() */
+void
+arena_free(struct arena *arena, void *ptr)
+{
+    if (arena == NULL) {
+        free(ptr);
+    }
+}
+
+char
+*arena_strdup(struct arena *arena, const char *str)
+{
+    size_t len = strlen(str);
+    char *dup = arena_alloc(arena, len + 1);
+    memcpy(dup, str, len + 1);
+    return dup;
+}
+
+char
+*arena_asprintf(struct arena *arena, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    if (len < 0) {
+        fprintf(stderr, "ERROR: Could not format string\n");
+        abort();
+    }
+
+    char *str = arena_alloc(arena, len + 1);
+    va_start(ap, fmt);
+    vsnprintf(str, len + 1, fmt, ap);
+    va_end(ap);
+    return str;
+}
+
+/*
+ * Give back everything allocated from the arena. The most recent block is kept
+ * for reuse so that a worker's steady state makes no calls to malloc() at all.
+ */
+void
+arena_reset(struct arena *arena)
+{
+    struct arena_block *block = arena->blocks;
+    if (block == NULL) {
+        return;
+    }
+    struct arena_block *next = block->next;
+    while (next != NULL) {
+        struct arena_block *tmp = next->next;
+        free(next);
+        next = tmp;
+    }
+    block->next = NULL;
+    block->used = 0;
+}
+
+void
+arena_destroy(struct arena *arena)
+{
+    struct arena_block *block = arena->blocks;
+    while (block != NULL) {
+        struct arena_block *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->blocks = NULL;
+}
@@ -0,0 +1,56 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Copyright (c) 2026 David Jackson
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdlib.h>
+
+struct arena_block {
+    struct arena_block *next;
+    size_t size;
+    size_t used;
+    char data[];
+};
+
+/*
+ * A bump-pointer allocator for the short-lived strings made while processing a
+ * single file. Each worker owns one and resets it after every file, so none of
+ * those allocations go through (or contend on) malloc().
+ *
+ * Every function that takes an arena also accepts NULL, in which case it falls
+ * back to the heap and the caller must free() the result as usual.
+ */
+struct arena {
+    struct arena_block *blocks;
+};
+
+void
+arena_init(struct arena *arena);
+
+void
+*arena_alloc(struct arena *arena, size_t size);
+
+void
+arena_free(struct arena *arena, void *ptr);
+
+char
+*arena_strdup(struct arena *arena, const char *str);
+
+char
+*arena_asprintf(struct arena *arena, const char *fmt, ...);
+
+void
+arena_reset(struct arena *arena);
+
+void
+arena_destroy(struct arena *arena);
+
+#endif /* ARENA_H */
@@ -0,0 +1,260 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Copyright (c) 2026 David Jackson
+ */
+
+#include "config.h"
+
+#include "build_daemon.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define REQUEST_BUFSIZE BUILD_DAEMON_REQUEST_MAX
+#define RESPONSE_BUFSIZE 4096
+#define REQUEST_TIMEOUT_MS 5000
+
+static bool
+socket_address(const char *socket_name, struct sockaddr_un *addr)
+{
+    memset(addr, 0, sizeof(struct sockaddr_un));
+    addr->sun_family = AF_UNIX;
+    if (strlen(socket_name) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "ERROR: Socket path too long: %s\n", socket_name);
+        return false;
+    }
+    strcpy(addr->sun_path, socket_name);
+    return true;
+}
+
+/*
+ * Listen on the given socket, replacing it if it was left behind by a daemon
+ * that has gone away. Returns -1 if another daemon is already listening.
+ */
+int
+build_daemon_listen(const char *socket_name)
+{
+    struct sockaddr_un addr;
+    if (!socket_address(socket_name, &addr)) {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        perror("socket");
+        return -1;
+    }
+    int bound = bind(fd, (struct sockaddr *) &addr, sizeof(addr));
+    if (bound == -1 && errno == EADDRINUSE) {
+        int client_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        bool in_use = client_fd != -1
+            && connect(client_fd, (struct sockaddr *) &addr, sizeof(addr)) == 0;
+        if (client_fd != -1) {
+            close(client_fd);
+        }
+        if (in_use) {
+            fprintf(stderr, "ERROR: A daemon is already running\n");
+            close(fd);
+            return -1;
+        }
+        unlink(socket_name);
+        bound = bind(fd, (struct sockaddr *) &addr, sizeof(addr));
+    }
+    if (bound == -1) {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+    if (listen(fd, SOMAXCONN) == -1) {
+        perror("listen");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Milliseconds left until the deadline, or 0 if it has passed */
+static int
+ms_until(const struct timespec *deadline)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long ms = (deadline->tv_sec - now.tv_sec) * 1000
+        + (deadline->tv_nsec - now.tv_nsec) / 1000000;
+    return ms > 0 ? (int) ms : 0;
+}
+
+/*
+ * Read a client's request line into buf, giving up on a client that has not
+ * sent all of it in time, so that one that never does cannot hold up the
+ * others. Returns false, with errno set to ETIMEDOUT, if it timed out, or
+ * with errno set to EINTR if interrupted.
+ */
+static bool
+read_request(int client_fd, char *buf, size_t *len_ptr)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += REQUEST_TIMEOUT_MS / 1000;
+
+    size_t len = 0;
+    while (len < REQUEST_BUFSIZE - 1) {
+        struct pollfd pollfd;
+        pollfd.fd = client_fd;
+        pollfd.events = POLLIN;
+        int ready = poll(&pollfd, 1, ms_until(&deadline));
+        if (ready == 0) {
+            errno = ETIMEDOUT;
+            return false;
+        } else if (ready == -1) {
+            return false;
+        }
+        ssize_t n = read(client_fd, buf + len, REQUEST_BUFSIZE - 1 - len);
+        if (n == -1 && errno == EINTR) {
+            return false;
+        } else if (n <= 0) {
+            break;
+        }
+        len += n;
+        if (memchr(buf, '\n', len) != NULL) {
+            break;
+        }
+    }
+    buf[len] = '\0';
+    *len_ptr = len;
+    return true;
+}
+
+/*
+ * Wait for a client and read its request line. Returns the client's socket,
+ * or -1 if interrupted. The command is checked before the request line is
+ * copied to request, without its newline, for the caller to check the rest.
+ */
+int
+build_daemon_accept(int listen_fd, char *request, size_t request_size)
+{
+    size_t command_len = strlen(BUILD_DAEMON_GENERATE);
+    char buf[REQUEST_BUFSIZE];
+    size_t len;
+
+    while (true) {
+        int client_fd = accept(listen_fd, NULL, NULL);
+        if (client_fd == -1) {
+            if (errno != EINTR) {
+                perror("accept");
+            }
+            return -1;
+        }
+
+        if (!read_request(client_fd, buf, &len)) {
+            bool interrupted = errno == EINTR;
+            close(client_fd);
+            if (interrupted) {
+                return -1;
+            }
+            fprintf(stderr, "WARNING: Dropped a client that sent no request\n");
+            continue;
+        }
+        char *newline = strchr(buf, '\n');
+        if (newline != NULL
+            && (size_t) (newline - buf) < request_size
+            && strncmp(buf, BUILD_DAEMON_GENERATE, command_len) == 0
+            && (buf[command_len] == ' ' || buf[command_len] == '\n')) {
+            *newline = '\0';
+            strcpy(request, buf);
+            return client_fd;
+        }
+        dprintf(client_fd, "Unrecognized request\n");
+        build_daemon_finish(client_fd, EXIT_FAILURE);
+    }
+}
+
+void
+build_daemon_finish(int client_fd, int status)
+{
+    dprintf(client_fd, "%s%d\n", BUILD_DAEMON_STATUS, status);
+    close(client_fd);
+}
+
+/*
+ * Send a request to the daemon and copy its output to stdout. Returns the
+ * daemon's exit status, or -1 if no daemon is listening on the socket or it
+ * declined the request.
+ */
+int
+build_daemon_request(const char *socket_name, const char *request)
+{
+    struct sockaddr_un addr;
+    char buf[RESPONSE_BUFSIZE];
+    size_t len;
+    int status;
+
+    if (!socket_address(socket_name, &addr)) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+    if (dprintf(fd, "%s\n", request) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    /* Print everything up to the status line, which comes last */
+    status = EXIT_FAILURE;
+    len = 0;
+    while (true) {
+        ssize_t n = read(fd, buf + len, RESPONSE_BUFSIZE - 1 - len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        len += n;
+        buf[len] = '\0';
+
+        char *line = buf;
+        char *newline;
+        while ((newline = strchr(line, '\n')) != NULL) {
+            size_t status_len = strlen(BUILD_DAEMON_STATUS);
+            if (strncmp(line, BUILD_DAEMON_STATUS, status_len) == 0) {
+                status = atoi(line + status_len);
+            } else {
+                fwrite(line, 1, newline - line + 1, stdout);
+            }
+            line = newline + 1;
+        }
+
+        /* Keep a partial line for the next read unless it fills the buffer */
+        len = strlen(line);
+        if (len == RESPONSE_BUFSIZE - 1) {
+            fwrite(line, 1, len, stdout);
+            len = 0;
+        } else {
+            memmove(buf, line, len);
+        }
+    }
+    fwrite(buf, 1, len, stdout);
+    fflush(stdout);
+    close(fd);
+    return status;
+}
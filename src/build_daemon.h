@@ -0,0 +1,42 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Copyright (c) 2026 David Jackson
+ */
+
+#ifndef BUILD_DAEMON_H
+#define BUILD_DAEMON_H
+
+#include <stddef.h>
+
+#define BUILD_DAEMON_SOCKET ".cyto-daemon.sock"
+
+/*
+ * A client connects to the daemon's UNIX socket and sends a request line: the
+ * command, followed by the options to build with. The daemon streams back the
+ * build's output followed by a status line with the exit status of the build,
+ * or BUILD_DAEMON_DECLINED if it does not build with those options, in which
+ * case the client builds by itself.
+ */
+#define BUILD_DAEMON_GENERATE "generate"
+#define BUILD_DAEMON_STATUS "cyto-status: "
+#define BUILD_DAEMON_DECLINED -1
+#define BUILD_DAEMON_REQUEST_MAX 8192
+
+int
+build_daemon_listen(const char *socket_name);
+
+int
+build_daemon_accept(int listen_fd, char *request, size_t request_size);
+
+void
+build_daemon_finish(int client_fd, int status);
+
+int
+build_daemon_request(const char *socket_name, const char *request);
+
+#endif /* BUILD_DAEMON_H */
@@ -0,0 +1,306 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Copyright (c) 2026 David Jackson
+ */
+
+#include "config.h"
+
+#include "cache.h"
+#include "hash.h"
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+
+/*
+ * The cache directory to use when none is given: $CYTO_CACHE_DIR, if it is
+ * set. Returns NULL if it is not, since nothing evicts the entries of a cache
+ * but cache_clean(), so there is only one where it is asked for.
+ */
+char
+*cache_default_dir(void)
+{
+    const char *env_dir = getenv(CACHE_DIR_ENV);
+    return env_dir != NULL ? strdup(env_dir) : NULL;
+}
+
+/* Create every missing directory along the path */
+static bool
+make_directories(const char *path)
+{
+    char *dir = strdup(path);
+    char *slash = dir;
+    while ((slash = strchr(slash + 1, '/')) != NULL) {
+        *slash = '\0';
+        mkdir(dir, 0755);
+        *slash = '/';
+    }
+    mkdir(dir, 0755);
+    free(dir);
+
+    struct stat statbuf;
+    return stat(path, &statbuf) == 0 && S_ISDIR(statbuf.st_mode);
+}
+
+/* Returns false, leaving the cache disabled, if the directory is unusable */
+bool
+cache_init(struct cache *cache, const char *dir)
+{
+    cache->dir = NULL;
+    if (dir == NULL || dir[0] == '\0' || strcmp(dir, CACHE_NONE) == 0) {
+        return false;
+    }
+    if (!make_directories(dir)) {
+        fprintf(stderr, "WARNING: Not using render cache %s\n", dir);
+        return false;
+    }
+    cache->dir = strdup(dir);
+    return true;
+}
+
+#define CACHE_ENTRY_MAGIC "cyto-cache"
+
+void
+cache_key_init(struct cache_key *key,
+               const char *path,
+               uint64_t source,
+               uint64_t deps,
+               uint64_t data)
+{
+    key->path = path;
+    key->source = source;
+    key->deps = deps;
+    key->data = data;
+    uint64_t hash = hash_string(HASH_INIT, path);
+    hash = hash_bytes(hash, &source, sizeof(uint64_t));
+    hash = hash_bytes(hash, &deps, sizeof(uint64_t));
+    hash = hash_bytes(hash, &data, sizeof(uint64_t));
+    key->hash = hash != 0 ? hash : 1;
+}
+
+/*
+ * The header each entry starts with, which spells out its whole key. The path
+ * comes last, since it may hold anything.
+ */
+static char
+*cache_entry_header(const struct cache_key *key, size_t *len_ptr)
+{
+    char *header;
+    int len = asprintf(&header,
+                       "%s %s %016" PRIx64 " %016" PRIx64 " %016" PRIx64
+                       " %s\n",
+                       CACHE_ENTRY_MAGIC,
+                       PACKAGE_VERSION,
+                       key->source,
+                       key->deps,
+                       key->data,
+                       key->path);
+    if (len == -1) {
+        fprintf(stderr, "ERROR: Could not asprintf() cache entry header\n");
+        abort();
+    }
+    *len_ptr = len;
+    return header;
+}
+
+/* Entries are spread over 256 subdirectories by the first byte of the key */
+static char
+*cache_file_name(struct cache *cache, uint64_t key)
+{
+    char *file_name;
+    if (asprintf(&file_name, "%s/%02x/%016" PRIx64,
+                 cache->dir,
+                 (unsigned int) (key >> 56),
+                 key) == -1) {
+        fprintf(stderr, "ERROR: Could not asprintf() cache file name\n");
+        abort();
+    }
+    return file_name;
+}
+
+/*
+ * Read the cached output for key into a newly-allocated buffer. Returns NULL
+ * on a miss, which includes an entry made from anything but the key.
+ */
+char
+*cache_load(struct cache *cache,
+            const struct cache_key *key,
+            size_t *len_ptr)
+{
+    if (cache == NULL || cache->dir == NULL || key == NULL || key->hash == 0) {
+        return NULL;
+    }
+
+    char *file_name = cache_file_name(cache, key->hash);
+    FILE *fp = fopen(file_name, "rb");
+    free(file_name);
+    if (fp == NULL) {
+        return NULL;
+    }
+    size_t header_len;
+    char *header = cache_entry_header(key, &header_len);
+    struct stat statbuf;
+    char *buf = NULL;
+    if (fstat(fileno(fp), &statbuf) == 0
+        && (size_t) statbuf.st_size >= header_len) {
+        size_t len = statbuf.st_size;
+        buf = malloc(len + 1);
+        if (buf == NULL) {
+            fprintf(stderr, "ERROR: Could not malloc() for cache entry\n");
+            abort();
+        }
+        if (fread(buf, 1, len, fp) == len
+            && memcmp(buf, header, header_len) == 0) {
+            len -= header_len;
+            memmove(buf, buf + header_len, len);
+            buf[len] = '\0';
+            *len_ptr = len;
+        } else {
+            free(buf);
+            buf = NULL;
+        }
+    }
+    free(header);
+    fclose(fp);
+    return buf;
+}
+
+/*
+ * Entries are written to a file of their own and renamed into place, so that
+ * builds running at the same time never see one half-written.
+ */
+static FILE
+*cache_open_tmp(struct cache *cache, uint64_t key, char **tmp_file_name_ptr)
+{
+    char *file_name = cache_file_name(cache, key);
+    char *dir = strdup(file_name);
+    *strrchr(dir, '/') = '\0';
+    mkdir(dir, 0755);
+    free(dir);
+
+    char *tmp_file_name;
+    asprintf(&tmp_file_name, "%s.%ld.%lx.tmp",
+             file_name,
+             (long) getpid(),
+             (unsigned long) pthread_self());
+    free(file_name);
+
+    FILE *fp = fopen(tmp_file_name, "wb");
+    if (fp == NULL) {
+        free(tmp_file_name);
+        return NULL;
+    }
+    *tmp_file_name_ptr = tmp_file_name;
+    return fp;
+}
+
+static void
+cache_close_tmp(struct cache *cache, uint64_t key, FILE *fp,
+                char *tmp_file_name, bool ok)
+{
+    if (fclose(fp) != 0) {
+        ok = false;
+    }
+    if (ok) {
+        char *file_name = cache_file_name(cache, key);
+        ok = rename(tmp_file_name, file_name) == 0;
+        free(file_name);
+    }
+    if (!ok) {
+        unlink(tmp_file_name);
+    }
+    free(tmp_file_name);
+}
+
+void
+cache_store(struct cache *cache,
+            const struct cache_key *key,
+            const char *buf,
+            size_t len)
+{
+    if (cache == NULL || cache->dir == NULL || key == NULL || key->hash == 0) {
+        return;
+    }
+    char *tmp_file_name;
+    FILE *fp = cache_open_tmp(cache, key->hash, &tmp_file_name);
+    if (fp != NULL) {
+        size_t header_len;
+        char *header = cache_entry_header(key, &header_len);
+        bool ok = fwrite(header, 1, header_len, fp) == header_len
+            && fwrite(buf, 1, len, fp) == len;
+        free(header);
+        cache_close_tmp(cache, key->hash, fp, tmp_file_name, ok);
+    }
+}
+
+/* Whether the name is len lowercase hex digits, as the cache names entries */
+static bool
+is_hex_name(const char *name, size_t len)
+{
+    size_t i;
+    for (i = 0; i < len; i++) {
+        if (!((name[i] >= '0' && name[i] <= '9')
+              || (name[i] >= 'a' && name[i] <= 'f'))) {
+            return false;
+        }
+    }
+    return name[len] == '\0' || name[len] == '.';
+}
+
+/*
+ * Remove every entry from the cache in the directory, along with any left
+ * half-written, then the directory itself if that leaves it empty. Anything
+ * else in the directory is left alone.
+ */
+void
+cache_clean(const char *dir_name)
+{
+    if (dir_name == NULL || dir_name[0] == '\0'
+        || strcmp(dir_name, CACHE_NONE) == 0) {
+        return;
+    }
+    DIR *dir = opendir(dir_name);
+    struct dirent *dirent;
+    while (dir != NULL && (dirent = readdir(dir)) != NULL) {
+        if (strlen(dirent->d_name) != 2 || !is_hex_name(dirent->d_name, 2)) {
+            continue;
+        }
+        char *sub_dir_name;
+        asprintf(&sub_dir_name, "%s/%s", dir_name, dirent->d_name);
+        DIR *sub_dir = opendir(sub_dir_name);
+        struct dirent *entry;
+        while (sub_dir != NULL && (entry = readdir(sub_dir)) != NULL) {
+            if (strlen(entry->d_name) >= 16 && is_hex_name(entry->d_name, 16)) {
+                char *file_name;
+                asprintf(&file_name, "%s/%s", sub_dir_name, entry->d_name);
+                unlink(file_name);
+                free(file_name);
+            }
+        }
+        if (sub_dir != NULL) {
+            closedir(sub_dir);
+        }
+        rmdir(sub_dir_name);
+        free(sub_dir_name);
+    }
+    if (dir != NULL) {
+        closedir(dir);
+    }
+    rmdir(dir_name);
+}
+
+void
+cache_destroy(struct cache *cache)
+{
+    free(cache->dir);
+    cache->dir = NULL;
+}
@@ -0,0 +1,75 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Copyright (c) 2026 David Jackson
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#define CACHE_DIR_ENV "CYTO_CACHE_DIR"
+#define CACHE_NONE "none"
+
+/*
+ * Everything that goes into rendering an output: the source, its layouts,
+ * the data it uses and the build of cyto. Entries are named by a hash of it,
+ * and store it in full, so that an entry whose name collides with another's
+ * is taken for a miss instead of publishing the wrong output.
+ */
+struct cache_key {
+    uint64_t hash; /* 0 if the output is not to be cached */
+    const char *path; /* The source, as it is named in the site */
+    uint64_t source; /* Hash of the source's contents */
+    uint64_t deps; /* Hash of its layout chain, the config and cyto itself */
+    uint64_t data; /* Hash of the posts if it uses them, otherwise 0 */
+};
+
+/*
+ * A directory of rendered outputs, shared by every build that is given it.
+ * Since the key says what the output is made from, an entry never goes
+ * stale, but nor is one ever evicted, so the cache is only used when asked
+ * for.
+ */
+struct cache {
+    char *dir;
+};
+
+void
+cache_key_init(struct cache_key *key,
+               const char *path,
+               uint64_t source,
+               uint64_t deps,
+               uint64_t data);
+
+char
+*cache_default_dir(void);
+
+bool
+cache_init(struct cache *cache, const char *dir);
+
+char
+*cache_load(struct cache *cache,
+            const struct cache_key *key,
+            size_t *len_ptr);
+
+void
+cache_store(struct cache *cache,
+            const struct cache_key *key,
+            const char *buf,
+            size_t len);
+
+void
+cache_clean(const char *dir_name);
+
+void
+cache_destroy(struct cache *cache);
+
+#endif /* CACHE_H */
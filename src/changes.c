@@ -0,0 +1,264 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Copyright (c) 2026 David Jackson
+ */
+
+#include "config.h"
+
+#include "changes.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <dirent.h>
+
+#define CHANGES_VERSION 1
+#define DEFAULT_CHANGES_BUFSIZE 64
+#define LINE_BUFSIZE 8192
+
+/*
+ * The changes are a text file: a version line, then one tab-separated line per
+ * output holding what happened to it, the hash of its new contents ("-" if it
+ * was deleted) and its path within the site, sorted by path.
+ */
+
+static const char *kind_names[] = {
+    [FILE_UNCHANGED] = "unchanged",
+    [FILE_ADDED] = "added",
+    [FILE_MODIFIED] = "modified",
+    [FILE_DELETED] = "deleted"
+};
+
+void
+changes_init(struct changes *changes, const char *site_dir)
+{
+    changes->changes_bufsize = DEFAULT_CHANGES_BUFSIZE;
+    changes->num_changes = 0;
+    changes->changes = malloc(sizeof(struct change)
+                              * changes->changes_bufsize);
+    if (changes->changes == NULL) {
+        fprintf(stderr, "ERROR: Could not malloc() for changes\n");
+        abort();
+    }
+    changes->site_dir_len = strlen(site_dir);
+    pthread_mutex_init(&(changes->mutex), NULL);
+}
+
+static void
+changes_add(struct changes *changes,
+            enum file_change kind,
+            const char *path,
+            uint64_t hash)
+{
+    pthread_mutex_lock(&(changes->mutex));
+    if (changes->num_changes >= changes->changes_bufsize) {
+        changes->changes_bufsize *= 2;
+        size_t bufsize = sizeof(struct change) * changes->changes_bufsize;
+        changes->changes = realloc(changes->changes, bufsize);
+        if (changes->changes == NULL) {
+            fprintf(stderr, "ERROR: Could not realloc() for changes\n");
+            abort();
+        }
+    }
+    struct change *change = &(changes->changes[changes->num_changes]);
+    change->path = strdup(path);
+    change->kind = kind;
+    change->hash = hash;
+    change->seq = changes->num_changes;
+    changes->num_changes++;
+    pthread_mutex_unlock(&(changes->mutex));
+}
+
+/* Record a change to an output. NULL changes and unchanged outputs are fine */
+void
+changes_record(struct changes *changes,
+               enum file_change kind,
+               const char *out_path,
+               uint64_t hash)
+{
+    if (changes == NULL || kind == FILE_UNCHANGED) {
+        return;
+    }
+    const char *path = out_path + changes->site_dir_len;
+    while (*path == '/') {
+        path++;
+    }
+    changes_add(changes, kind, path, hash);
+}
+
+static void
+changes_read(struct changes *changes, const char *file_name)
+{
+    FILE *fp = fopen(file_name, "r");
+    if (fp == NULL) {
+        return;
+    }
+    char *line = malloc(LINE_BUFSIZE);
+    int version = 0;
+    if (fscanf(fp, "cyto-changes %d\n", &version) == 1
+        && version == CHANGES_VERSION) {
+        while (fgets(line, LINE_BUFSIZE, fp) != NULL) {
+            char *hash_str = strchr(line, '\t');
+            char *path = hash_str != NULL ? strchr(hash_str + 1, '\t') : NULL;
+            char *newline = path != NULL ? strchr(path, '\n') : NULL;
+            if (newline == NULL) {
+                continue;
+            }
+            *hash_str++ = '\0';
+            *path++ = '\0';
+            *newline = '\0';
+            enum file_change kind;
+            for (kind = FILE_ADDED; kind <= FILE_DELETED; kind++) {
+                if (strcmp(line, kind_names[kind]) == 0) {
+                    changes_add(changes,
+                                kind,
+                                path,
+                                strtoull(hash_str, NULL, 16));
+                }
+            }
+        }
+    }
+    free(line);
+    fclose(fp);
+}
+
+/*
+ * Take in the changes made by the shards of a sharded build, so that those
+ * are reported along with the ones made by the build that finishes it.
+ */
+void
+changes_read_shards(struct changes *changes, const char *site_dir)
+{
+    size_t prefix_len = strlen(CHANGES_SHARD_PREFIX);
+    DIR *dir = opendir(site_dir);
+    if (dir == NULL) {
+        return;
+    }
+    struct dirent *dirent;
+    while ((dirent = readdir(dir)) != NULL) {
+        if (strncmp(dirent->d_name, CHANGES_SHARD_PREFIX, prefix_len) != 0) {
+            continue;
+        }
+        char *file_name;
+        asprintf(&file_name, "%s/%s", site_dir, dirent->d_name);
+        changes_read(changes, file_name);
+        unlink(file_name);
+        free(file_name);
+    }
+    closedir(dir);
+}
+
+/* Whether the shards of a sharded build have left changes to take in */
+bool
+changes_have_shards(const char *site_dir)
+{
+    size_t prefix_len = strlen(CHANGES_SHARD_PREFIX);
+    DIR *dir = opendir(site_dir);
+    if (dir == NULL) {
+        return false;
+    }
+    bool found = false;
+    struct dirent *dirent;
+    while (!found && (dirent = readdir(dir)) != NULL) {
+        found = strncmp(dirent->d_name, CHANGES_SHARD_PREFIX, prefix_len) == 0;
+    }
+    closedir(dir);
+    return found;
+}
+
+static int
+change_compare(const void *change_1, const void *change_2)
+{
+    const struct change *c1 = (const struct change *) change_1;
+    const struct change *c2 = (const struct change *) change_2;
+    int strcmp_retval = strcmp(c1->path, c2->path);
+    if (strcmp_retval != 0) {
+        return strcmp_retval;
+    }
+    return c1->seq - c2->seq;
+}
+
+/*
+ * Several changes to one output come down to one: what it is now compared to
+ * what it was before the first of them.
+ */
+static enum file_change
+combined_kind(enum file_change first, enum file_change last)
+{
+    if (first == FILE_ADDED) {
+        return last == FILE_DELETED ? FILE_UNCHANGED : FILE_ADDED;
+    }
+    if (first == FILE_DELETED && last != FILE_DELETED) {
+        return FILE_MODIFIED;
+    }
+    return last;
+}
+
+/* Written to a temporary file first so that a crash never leaves half of one */
+void
+changes_write(struct changes *changes, const char *file_name)
+{
+    qsort(changes->changes,
+          changes->num_changes,
+          sizeof(struct change),
+          change_compare);
+
+    char *tmp_file_name;
+    if (asprintf(&tmp_file_name, "%s.tmp", file_name) == -1) {
+        fprintf(stderr, "ERROR: Could not asprintf() changes file name\n");
+        abort();
+    }
+    FILE *fp = fopen(tmp_file_name, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "ERROR: Could not open for writing: %s\n", tmp_file_name);
+        free(tmp_file_name);
+        return;
+    }
+
+    fprintf(fp, "cyto-changes %d\n", CHANGES_VERSION);
+    int i = 0;
+    while (i < changes->num_changes) {
+        struct change *first = &(changes->changes[i]);
+        struct change *last = first;
+        for (i++; i < changes->num_changes; i++) {
+            if (strcmp(changes->changes[i].path, first->path) != 0) {
+                break;
+            }
+            last = &(changes->changes[i]);
+        }
+        enum file_change kind = combined_kind(first->kind, last->kind);
+        if (kind == FILE_DELETED) {
+            fprintf(fp, "%s\t-\t%s\n", kind_names[kind], first->path);
+        } else if (kind != FILE_UNCHANGED) {
+            fprintf(fp, "%s\t%016" PRIx64 "\t%s\n",
+                    kind_names[kind], last->hash, first->path);
+        }
+    }
+
+    if (fclose(fp) == 0) {
+        rename(tmp_file_name, file_name);
+    } else {
+        fprintf(stderr, "ERROR: Could not write %s\n", tmp_file_name);
+        unlink(tmp_file_name);
+    }
+    free(tmp_file_name);
+}
+
+void
+changes_destroy(struct changes *changes)
+{
+    int i;
+    for (i = 0; i < changes->num_changes; i++) {
+        free(changes->changes[i].path);
+    }
+    free(changes->changes);
+    changes->changes = NULL;
+    changes->num_changes = 0;
+    pthread_mutex_destroy(&(changes->mutex));
+}
@@ -0,0 +1,63 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Copyright (c) 2026 David Jackson
+ */
+
+#ifndef CHANGES_H
+#define CHANGES_H
+
+#include "files.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#define CHANGES_FILE_NAME ".cyto-changes"
+#define CHANGES_SHARD_PREFIX ".cyto-changes.shard-"
+
+struct change {
+    char *path; /* Relative to the site directory */
+    enum file_change kind;
+    uint64_t hash; /* Hash of the output's new contents */
+    int seq; /* Keeps the changes to one path in the order they were made */
+};
+
+/*
+ * The outputs a build added, modified or deleted, so that a deploy only has to
+ * push those instead of comparing the whole site. Safe to record from any
+ * worker.
+ */
+struct changes {
+    struct change *changes;
+    int num_changes;
+    int changes_bufsize;
+    size_t site_dir_len;
+    pthread_mutex_t mutex;
+};
+
+void
+changes_init(struct changes *changes, const char *site_dir);
+
+void
+changes_record(struct changes *changes,
+               enum file_change kind,
+               const char *out_path,
+               uint64_t hash);
+
+void
+changes_read_shards(struct changes *changes, const char *site_dir);
+
+bool
+changes_have_shards(const char *site_dir);
+
+void
+changes_write(struct changes *changes, const char *file_name);
+
+void
+changes_destroy(struct changes *changes);
+
+#endif /* CHANGES_H */
@@ -13,5 +13,6 @@
 
 #define CONFIG_FILE_NAME "_config.json"
 #define LAYOUT "layout"
+#define POSTS_KEY "posts"
 
 #endif /* CYTO_COMMON_H */
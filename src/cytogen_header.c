@@ -5,7 +5,7 @@
  */
 
 /*
- * Copyright (c) 2016-2021 David Jackson
+ * Copyright (c) 2016-2026 David Jackson
  */
 
 #include "cyto_config.h"
@@ -15,7 +15,6 @@
 #include <stdbool.h>
 #include "cytogen_header.h"
 #include "string_util.h"
-#include "files.h"
 
 #define CYTO_HEADER_BORDER "---"
 
@@ -43,11 +42,11 @@ is_reserved(const char *str)
 }
 
 int
-next_line_length(const char *str, size_t str_len, int start)
+next_line_length(const char *str, size_t str_len, size_t start)
 {
     int line_len;
     int ch;
-    int idx;
+    size_t idx;
 
     if (start >= str_len) {
         return -1;
@@ -55,35 +54,37 @@ next_line_length(const char *str, size_t str_len, int start)
 
     line_len = 0;
     idx = start;
-    while ((ch = str[idx++]) != '\0' && ch != '\n') {
+    while (idx < str_len && (ch = str[idx++]) != '\0' && ch != '\n') {
         line_len++;
     }
     return line_len;
 }
 
 static char
-*read_line_from_string(const char *str, size_t str_len, int start)
+*read_line_from_string(const char *str,
+                       size_t str_len,
+                       size_t start,
+                       struct arena *arena)
 {
     char *line;
     int line_len = next_line_length(str, str_len, start);
     if (line_len < 0) {
         return NULL;
     }
-    line = malloc(line_len + 1);
-    if (line == NULL) {
-        fprintf(stderr, "ERROR: Could not malloc in read_line_from_string()\n");
-        abort();
-    }
+    line = arena_alloc(arena, line_len + 1);
     memset(line, 0, line_len + 1);
     strncpy(line, str + start, line_len);
     return line;
 }
 
+/* Read the header from the first str_len bytes of str, which may lack a NUL */
 int
-cytogen_header_read_from_string(const char *str, ctache_data_t *data)
+cytogen_header_read_from_span(const char *str,
+                              size_t str_len,
+                              ctache_data_t *data,
+                              struct arena *arena)
 {
-    size_t str_len;
-    int str_index;
+    size_t str_index;
     char *line;
     size_t line_len;
     int ch;
@@ -94,11 +95,10 @@ cytogen_header_read_from_string(const char *str, ctache_data_t *data)
     int header_length;
 
     index = -1;
-    str_len = strlen(str);
     key = NULL;
     value = NULL;
     str_index = 0;
-    line = read_line_from_string(str, str_len, str_index);
+    line = read_line_from_string(str, str_len, str_index, arena);
     if (line == NULL) {
         return 0; /* No line could be read */
     }
@@ -106,21 +106,21 @@ cytogen_header_read_from_string(const char *str, ctache_data_t *data)
     str_index += line_len + 1; /* The +1 is for the newline */
 
     if (strcmp(line, CYTO_HEADER_BORDER) == 0) {
-        line = read_line_from_string(str, str_len, str_index);
+        line = read_line_from_string(str, str_len, str_index, arena);
         line_len = strlen(line);
         str_index += line_len + 1; /* The +1 is for the newline */
 
         while (strcmp(line, CYTO_HEADER_BORDER) != 0 && str_index < str_len) {
             if (line_len == 0) {
                 /* Skip empty lines */
-                line = read_line_from_string(str, str_len, str_index);
+                line = read_line_from_string(str, str_len, str_index, arena);
                 line_len = strlen(line);
                 str_index += 1; /* Add 1 to skip newline */
                 continue;
             }
-            key = malloc(line_len + 1);
+            key = arena_alloc(arena, line_len + 1);
             memset(key, 0, line_len + 1);
-            value = malloc(line_len + 1);
+            value = arena_alloc(arena, line_len + 1);
             memset(value, 0, line_len + 1);
             for (i = 0; i < line_len; i++) {
                 ch = line[i];
@@ -139,20 +139,20 @@ cytogen_header_read_from_string(const char *str, ctache_data_t *data)
                     && !ctache_data_hash_table_has_key(data, key)
                     && !is_reserved(key)) {
                 ctache_data_t *str_data;
-                char *value_trimmed = string_trim(value);
+                char *value_trimmed = string_trim(value, arena);
                 size_t value_len = strlen(value_trimmed);
                 str_data = ctache_data_create_string(value_trimmed, value_len);
                 ctache_data_hash_table_set(data, key, str_data);
-                free(value_trimmed);
-                free(value);
+                arena_free(arena, value_trimmed);
+                arena_free(arena, value);
             }
 
             value = NULL;
-            free(key);
+            arena_free(arena, key);
             key = NULL;
-            free(line);
+            arena_free(arena, line);
 
-            line = read_line_from_string(str, str_len, str_index);
+            line = read_line_from_string(str, str_len, str_index, arena);
             line_len = strlen(line);
             str_index += line_len + 1; /* The +1 is for the newline */
         }
@@ -162,26 +162,17 @@ cytogen_header_read_from_string(const char *str, ctache_data_t *data)
     }
 
     if (key != NULL) {
-        free(key);
+        arena_free(arena, key);
     }
-    free(line);
+    arena_free(arena, line);
 
     return header_length;
 }
 
 int
-cytogen_header_read_from_file(FILE *fp, ctache_data_t *data)
+cytogen_header_read_from_string(const char *str,
+                                ctache_data_t *data,
+                                struct arena *arena)
 {
-    char *file_content = read_file_contents(fp);
-    fseek(fp, 0, SEEK_SET); /* Rewind the file */
-
-    int header_length = cytogen_header_read_from_string(file_content, data);
-    bool file_has_header = header_length > 0;
-    if (file_has_header) {
-        fseek(fp, header_length, SEEK_CUR); /* Fast-forward to end of header */
-    }
-
-    free(file_content);
-
-    return header_length;
+    return cytogen_header_read_from_span(str, strlen(str), data, arena);
 }
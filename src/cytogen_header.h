@@ -5,7 +5,7 @@
  */
 
 /*
- * Copyright (c) 2016 David Jackson
+ * Copyright (c) 2016-2026 David Jackson
  */
 
 #ifndef CYTO_HEADER_H
@@ -13,11 +13,17 @@
 
 #include <stdio.h>
 #include <ctache/ctache.h>
+#include "arena.h"
 
 int
-cytogen_header_read_from_file(FILE *fp, ctache_data_t *data);
+cytogen_header_read_from_string(const char *str,
+                                ctache_data_t *data,
+                                struct arena *arena);
 
 int
-cytogen_header_read_from_string(const char *str, ctache_data_t *data);
+cytogen_header_read_from_span(const char *str,
+                              size_t str_len,
+                              ctache_data_t *data,
+                              struct arena *arena);
 
 #endif /* CYTO_HEADER_H */
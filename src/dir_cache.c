@@ -0,0 +1,228 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Copyright (c) 2026 David Jackson
+ */
+
+#include "config.h"
+
+#include "dir_cache.h"
+#include "hash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+#define DEFAULT_DIR_CACHE_BUFSIZE 64 /* Must be a power of 2 */
+
+/*
+ * Past this many, or a quarter of the process's file descriptors if that is
+ * fewer, directories are still created only once, but are then opened by
+ * their paths, so that a site with a directory for each of many thousands of
+ * posts does not run out of file descriptors.
+ */
+#define DIR_CACHE_MAX_FDS 256
+
+void
+dir_cache_init(struct dir_cache *cache)
+{
+    cache->entries_bufsize = DEFAULT_DIR_CACHE_BUFSIZE;
+    cache->num_entries = 0;
+    cache->num_fds = 0;
+    cache->max_fds = DIR_CACHE_MAX_FDS;
+    struct rlimit rlimit;
+    if (getrlimit(RLIMIT_NOFILE, &rlimit) == 0
+        && rlimit.rlim_cur != RLIM_INFINITY
+        && rlimit.rlim_cur / 4 < (rlim_t) cache->max_fds) {
+        cache->max_fds = rlimit.rlim_cur / 4;
+    }
+    cache->entries = calloc(cache->entries_bufsize,
+                            sizeof(struct dir_cache_entry));
+    if (cache->entries == NULL) {
+        fprintf(stderr, "ERROR: Could not calloc() for directory cache\n");
+        abort();
+    }
+    pthread_mutex_init(&(cache->mutex), NULL);
+}
+
+/* The slot that holds the path, or the empty slot it would go in */
+static struct dir_cache_entry
+*dir_cache_slot(struct dir_cache_entry *entries,
+                int entries_bufsize,
+                const char *path,
+                size_t path_len,
+                uint64_t hash)
+{
+    size_t mask = entries_bufsize - 1;
+    size_t i = hash & mask;
+    while (entries[i].path != NULL
+           && !(entries[i].hash == hash
+                && strncmp(entries[i].path, path, path_len) == 0
+                && entries[i].path[path_len] == '\0')) {
+        i = (i + 1) & mask;
+    }
+    return &(entries[i]);
+}
+
+static void
+dir_cache_grow(struct dir_cache *cache)
+{
+    int entries_bufsize = cache->entries_bufsize * 2;
+    struct dir_cache_entry *entries;
+    entries = calloc(entries_bufsize, sizeof(struct dir_cache_entry));
+    if (entries == NULL) {
+        fprintf(stderr, "ERROR: Could not calloc() for directory cache\n");
+        abort();
+    }
+    int i;
+    for (i = 0; i < cache->entries_bufsize; i++) {
+        struct dir_cache_entry *entry = &(cache->entries[i]);
+        if (entry->path != NULL) {
+            *dir_cache_slot(entries,
+                            entries_bufsize,
+                            entry->path,
+                            strlen(entry->path),
+                            entry->hash) = *entry;
+        }
+    }
+    free(cache->entries);
+    cache->entries = entries;
+    cache->entries_bufsize = entries_bufsize;
+}
+
+/*
+ * The handle of the directory with the first path_len bytes of path as its
+ * path, creating it and its parents if this build has not yet, or -1 if it is
+ * to be opened by its path. The mutex is only held to look the directory up
+ * and to add it, so that workers making different directories do not wait on
+ * each other. If two make the same one at once, the first to add it wins.
+ */
+static int
+dir_cache_get(struct dir_cache *cache, const char *path, size_t path_len)
+{
+    uint64_t hash = hash_bytes(HASH_INIT, path, path_len);
+    pthread_mutex_lock(&(cache->mutex));
+    struct dir_cache_entry *entry = dir_cache_slot(cache->entries,
+                                                   cache->entries_bufsize,
+                                                   path,
+                                                   path_len,
+                                                   hash);
+    if (entry->path != NULL) {
+        int fd = entry->fd;
+        pthread_mutex_unlock(&(cache->mutex));
+        return fd;
+    }
+    bool may_open = cache->num_fds < cache->max_fds;
+    if (may_open) {
+        cache->num_fds++; /* Reserve a handle */
+    }
+    pthread_mutex_unlock(&(cache->mutex));
+
+    char *dir = strndup(path, path_len);
+    if (dir == NULL) {
+        fprintf(stderr, "ERROR: Could not strndup() directory name\n");
+        abort();
+    }
+    const char *name = dir;
+    int parent_fd = AT_FDCWD;
+    char *slash = strrchr(dir, '/');
+    if (slash != NULL && slash != dir) {
+        parent_fd = dir_cache_get(cache, dir, slash - dir);
+        if (parent_fd == -1) {
+            parent_fd = AT_FDCWD;
+        } else {
+            name = slash + 1;
+        }
+    }
+    mkdirat(parent_fd, name, 0770); /* It may well exist already */
+    int fd = -1;
+    if (may_open) {
+        fd = openat(parent_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    }
+
+    pthread_mutex_lock(&(cache->mutex));
+    if (may_open && fd == -1) {
+        cache->num_fds--;
+    }
+    if ((cache->num_entries + 1) * 2 > cache->entries_bufsize) {
+        dir_cache_grow(cache);
+    }
+    entry = dir_cache_slot(cache->entries,
+                           cache->entries_bufsize,
+                           dir,
+                           path_len,
+                           hash);
+    if (entry->path != NULL) {
+        /* Another worker made it in the meantime */
+        if (fd != -1) {
+            close(fd);
+            cache->num_fds--;
+        }
+        fd = entry->fd;
+        free(dir);
+    } else {
+        entry->path = dir;
+        entry->hash = hash;
+        entry->fd = fd;
+        cache->num_entries++;
+    }
+    pthread_mutex_unlock(&(cache->mutex));
+    return fd;
+}
+
+/* Make a directory ahead of any file in it, e.g. one that may stay empty */
+void
+dir_cache_make(struct dir_cache *cache, const char *dir_name)
+{
+    dir_cache_get(cache, dir_name, strlen(dir_name));
+}
+
+/*
+ * Make sure the directory a file goes in exists, creating it only the first
+ * time, and return a handle to open the file relative to, along with the name
+ * to open it by. The handle is owned by the cache. A NULL cache gives the file
+ * name as it is, relative to the current directory.
+ */
+int
+dir_cache_parent(struct dir_cache *cache,
+                 const char *file_name,
+                 const char **name_ptr)
+{
+    *name_ptr = file_name;
+    const char *slash = strrchr(file_name, '/');
+    if (cache == NULL || slash == NULL || slash == file_name) {
+        return AT_FDCWD;
+    }
+    int fd = dir_cache_get(cache, file_name, slash - file_name);
+    if (fd == -1) {
+        return AT_FDCWD;
+    }
+    *name_ptr = slash + 1;
+    return fd;
+}
+
+void
+dir_cache_destroy(struct dir_cache *cache)
+{
+    int i;
+    for (i = 0; i < cache->entries_bufsize; i++) {
+        struct dir_cache_entry *entry = &(cache->entries[i]);
+        if (entry->path != NULL) {
+            if (entry->fd != -1) {
+                close(entry->fd);
+            }
+            free(entry->path);
+        }
+    }
+    free(cache->entries);
+    cache->entries = NULL;
+    pthread_mutex_destroy(&(cache->mutex));
+}
@@ -0,0 +1,52 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Copyright (c) 2026 David Jackson
+ */
+
+#ifndef DIR_CACHE_H
+#define DIR_CACHE_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+struct dir_cache_entry {
+    char *path; /* NULL if the slot is empty */
+    uint64_t hash;
+    int fd; /* -1 once the cache holds as many as it may */
+};
+
+/*
+ * The output directories a build has created, each with an open handle, so
+ * that each one is created only once per build and the outputs in it are
+ * opened relative to it instead of by their full paths. Safe to use from any
+ * worker.
+ */
+struct dir_cache {
+    struct dir_cache_entry *entries;
+    int num_entries;
+    int entries_bufsize;
+    int num_fds;
+    int max_fds;
+    pthread_mutex_t mutex;
+};
+
+void
+dir_cache_init(struct dir_cache *cache);
+
+void
+dir_cache_make(struct dir_cache *cache, const char *dir_name);
+
+int
+dir_cache_parent(struct dir_cache *cache,
+                 const char *file_name,
+                 const char **name_ptr);
+
+void
+dir_cache_destroy(struct dir_cache *cache);
+
+#endif /* DIR_CACHE_H */
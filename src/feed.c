@@ -5,14 +5,25 @@
  */
 
 /*
- * Copyright (c) 2016-2018 David Jackson
+ * Copyright (c) 2016-2026 David Jackson
  */
 
+#include "config.h"
+
 #include "cyto_config.h"
+#include "files.h"
+#include "feed.h"
+#include "hash.h"
 #include <ctache/ctache.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
 #include <time.h>
 
+#define FEED_FILE_NAME "feed.xml"
+#define UPDATED_BUFSIZE 30
+#define LINE_BUFSIZE 1024
+
 static void
 insert_entries(FILE *fp, ctache_data_t *posts)
 {
@@ -37,30 +48,25 @@ insert_entries(FILE *fp, ctache_data_t *posts)
     }
 }
     
-void
-generate_feed(struct cyto_config *config, ctache_data_t *posts)
+/* Render the whole feed into a newly-allocated buffer */
+static char
+*render_feed(struct cyto_config *config,
+             ctache_data_t *posts,
+             const char *updated,
+             size_t *len_ptr)
 {
-    char feed_file_name[] = "_site/feed.xml";
-    FILE *fp = fopen(feed_file_name, "w");
+    char *feed = NULL;
+    FILE *fp = open_memstream(&feed, len_ptr);
     if (fp == NULL) {
-        char fmt[] = "ERROR: Could not open file: %s\n";
-        fprintf(stderr, fmt, feed_file_name);
-        perror(NULL);
-        return;
+        fprintf(stderr, "ERROR: Could not open memory stream\n");
+        abort();
     }
 
-    time_t now;
-    struct tm tm;
-    char now_str[30];
-    time(&now);
-    localtime_r(&now, &tm);
-    strftime(now_str, 30, "%Y-%m-%dT%H:%M:%SZ", &tm);
-
     fprintf(fp, "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n");
     fprintf(fp, "<feed xmlns=\"http://www.w3.org/2005/Atom\">\n");
     fprintf(fp, "\t<title>%s</title>\n", config->title);
     fprintf(fp, "\t<link href=\"%s\" />\n", config->url);
-    fprintf(fp, "\t<updated>%s</updated>\n", now_str);
+    fprintf(fp, "\t<updated>%s</updated>\n", updated);
     fprintf(fp, "\t<id>%s</id>\n", config->url);
     fprintf(fp, "\t<author>\n");
     fprintf(fp, "\t\t<name>%s</name>\n", config->author);
@@ -71,4 +77,70 @@ generate_feed(struct cyto_config *config, ctache_data_t *posts)
     fprintf(fp, "</feed>");
 
     fclose(fp);
+    return feed;
+}
+
+/* Read the time the existing feed was last updated. Returns false if none */
+static bool
+read_feed_updated(const char *feed_file_name, char *updated, size_t bufsize)
+{
+    char line[LINE_BUFSIZE];
+    char fmt[32];
+    bool found = false;
+    FILE *fp = fopen(feed_file_name, "r");
+    if (fp == NULL) {
+        return false;
+    }
+    snprintf(fmt, sizeof(fmt), "\t<updated>%%%zu[^<]</updated>", bufsize - 1);
+    while (!found && fgets(line, LINE_BUFSIZE, fp) != NULL) {
+        found = sscanf(line, fmt, updated) == 1;
+    }
+    fclose(fp);
+    return found;
+}
+
+/*
+ * Write the feed, leaving it untouched if nothing but the time it was updated
+ * would change.
+ */
+void
+generate_feed(struct cyto_config *config,
+              ctache_data_t *posts,
+              const char *site_dir,
+              struct changes *changes)
+{
+    char *feed_file_name;
+    char *feed;
+    size_t feed_len;
+    char updated[UPDATED_BUFSIZE];
+
+    asprintf(&feed_file_name, "%s/%s", site_dir, FEED_FILE_NAME);
+    if (read_feed_updated(feed_file_name, updated, UPDATED_BUFSIZE)) {
+        feed = render_feed(config, posts, updated, &feed_len);
+        bool same = file_has_contents(feed_file_name, feed, feed_len);
+        free(feed);
+        if (same) {
+            free(feed_file_name);
+            return;
+        }
+    }
+
+    time_t now;
+    struct tm tm;
+    time(&now);
+    localtime_r(&now, &tm);
+    strftime(updated, UPDATED_BUFSIZE, "%Y-%m-%dT%H:%M:%SZ", &tm);
+
+    feed = render_feed(config, posts, updated, &feed_len);
+    enum file_change change = write_file_if_changed(feed_file_name,
+                                                    feed,
+                                                    feed_len);
+    if (change != FILE_UNCHANGED) {
+        changes_record(changes,
+                       change,
+                       feed_file_name,
+                       hash_bytes(HASH_INIT, feed, feed_len));
+    }
+    free(feed);
+    free(feed_file_name);
 }
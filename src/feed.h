@@ -12,9 +12,13 @@
 #define FEED_H
 
 #include "cyto_config.h"
+#include "changes.h"
 #include <ctache/ctache.h>
 
 void
-generate_feed(struct cyto_config *config, ctache_data_t *posts);
+generate_feed(struct cyto_config *config,
+              ctache_data_t *posts,
+              const char *site_dir,
+              struct changes *changes);
 
 #endif /* FEED_H */
@@ -5,22 +5,43 @@
  */
 
 /*
- * Copyright (c) 2016-2020 David Jackson
+ * Copyright (c) 2016-2026 David Jackson
  */
 
+#include "config.h"
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <dirent.h>
+#include <sys/types.h>
 #include <sys/stat.h>
 #include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#ifdef HAVE_LINUX_FS_H
+#include <linux/fs.h>
+#endif /* HAVE_LINUX_FS_H */
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif /* HAVE_SYS_SENDFILE_H */
+#include "arena.h"
+#include "files.h"
 
-#define DEFAULT_CONTENT_LENGTH 1024
 #define TEXT_EXTENSIONS_COUNT 4
+#define COMPARE_CHUNK_SIZE 16384
+#define COPY_KERNEL_CHUNK_SIZE (64 * 1024 * 1024)
+#define COPY_BUFFER_SIZE (1024 * 1024)
+#define COPY_BUFFER_ALIGNMENT 4096
     
 void
 get_file_list(const char *dir_name,
               char ***file_names_ptr,
+              off_t **file_sizes_ptr,
+              time_t **file_mtimes_ptr,
               int *num_files_ptr, 
               char ***directories_ptr,
               int *num_directories_ptr)
@@ -61,6 +82,8 @@ get_file_list(const char *dir_name,
     rewinddir(dir);
 
     char **file_names = malloc(sizeof(char*) * num_files);
+    off_t *file_sizes = malloc(sizeof(off_t) * num_files);
+    time_t *file_mtimes = malloc(sizeof(time_t) * num_files);
     char **directory_names = malloc(sizeof(char*) * num_directories);
     int index = 0;
     int dir_index = 0;
@@ -78,6 +101,8 @@ get_file_list(const char *dir_name,
             && file_name[0] != '_'
             && file_name[0] != '.') {
             file_names[index] = strdup(file_path);
+            file_sizes[index] = statbuf.st_size;
+            file_mtimes[index] = statbuf.st_mtime;
             index++;
         } else if (S_ISDIR(statbuf.st_mode)
                    && file_name[0] != '_'
@@ -90,11 +115,13 @@ get_file_list(const char *dir_name,
 
     closedir(dir);
     *file_names_ptr = file_names;
+    *file_sizes_ptr = file_sizes;
+    *file_mtimes_ptr = file_mtimes;
     *directories_ptr = directory_names;
 }
 
 char
-*file_extension(const char *file_name)
+*file_extension(const char *file_name, struct arena *arena)
 {
     size_t file_name_len;
     int i;
@@ -116,7 +143,7 @@ char
         }
     }
 
-    extension = malloc(extension_len + 1);
+    extension = arena_alloc(arena, extension_len + 1);
     memset(extension, 0, extension_len + 1);
     for (i = start_index; i < file_name_len; i++) {
         ch = file_name[i];
@@ -126,29 +153,133 @@ char
     return extension;
 }
 
+/*
+ * Read a whole file into a newly-allocated, NUL-terminated buffer, sized from
+ * the file so that it normally takes a single read. Returns NULL if the file
+ * cannot be read.
+ */
 char
-*read_file_contents(FILE *fp)
+*read_file(const char *file_name, size_t *len_ptr)
 {
-    char *content;
-    size_t content_length;
-    size_t content_bufsize;
-    int ch;
+    int fd = open(file_name, O_RDONLY);
+    if (fd == -1) {
+        return NULL;
+    }
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) == -1) {
+        close(fd);
+        return NULL;
+    }
 
-    content_bufsize = DEFAULT_CONTENT_LENGTH;
-    content = malloc(content_bufsize);
-    content_length = 0;
-    while ((ch = fgetc(fp)) != EOF) {
-        if (content_length + 1 >= content_bufsize - 1) { /* -1 is for '\0' */
-            content_bufsize *= 2;
-            content = realloc(content, content_bufsize);
+    /*
+     * Ask for a byte more than there is, so that the short read says the end
+     * of the file has been reached without a second read.
+     */
+    size_t bufsize = statbuf.st_size + 2;
+    char *content = malloc(bufsize);
+    size_t len = 0;
+    while (true) {
+        size_t wanted = bufsize - len - 1;
+        ssize_t bytes_read = read(fd, content + len, wanted);
+        if (bytes_read == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            free(content);
+            close(fd);
+            return NULL;
         }
-        content[content_length] = ch;
-        content_length++;
+        len += bytes_read;
+        if ((size_t) bytes_read < wanted) {
+            break;
+        }
+        bufsize *= 2; /* The file has grown since */
+        content = realloc(content, bufsize);
     }
-    content[content_length] = '\0';
+    close(fd);
+    content[len] = '\0';
+    *len_ptr = len;
     return content;
 }
 
+/*
+ * Map a whole file read-only, so that it can be worked on without copying it
+ * into the heap. Files that cannot be mapped are read instead. The data is not
+ * NUL-terminated. Returns false if the file cannot be read.
+ */
+bool
+map_file(const char *file_name, struct mapped_file *mf)
+{
+    int fd = open(file_name, O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) == -1) {
+        close(fd);
+        return false;
+    }
+
+    mf->data = "";
+    mf->len = 0;
+    mf->is_mapped = false;
+    if (statbuf.st_size == 0) {
+        close(fd); /* There is nothing to map */
+        return true;
+    }
+    void *data = mmap(NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data != MAP_FAILED) {
+        mf->data = data;
+        mf->len = statbuf.st_size;
+        mf->is_mapped = true;
+        return true;
+    }
+
+    char *content = read_file(file_name, &(mf->len));
+    if (content == NULL) {
+        return false;
+    }
+    if (mf->len == 0) {
+        free(content); /* The file has been emptied since */
+        return true;
+    }
+    mf->data = content;
+    return true;
+}
+
+void
+unmap_file(struct mapped_file *mf)
+{
+    if (mf->is_mapped) {
+        munmap((void *) mf->data, mf->len);
+    } else if (mf->len > 0) {
+        free((void *) mf->data);
+    }
+    mf->data = NULL;
+    mf->len = 0;
+    mf->is_mapped = false;
+}
+
+/*
+ * Take the contents of a file kept from mapping it earlier, leaving kept
+ * empty, or else map the file now. Either way they are the caller's to unmap.
+ */
+bool
+map_file_or_take(const char *file_name,
+                 struct mapped_file *kept,
+                 struct mapped_file *mf)
+{
+    if (kept->data == NULL) {
+        return map_file(file_name, mf);
+    }
+    *mf = *kept;
+    kept->data = NULL;
+    kept->len = 0;
+    kept->is_mapped = false;
+    return true;
+}
+
 bool
 extension_implies_markdown(const char *extension)
 {
@@ -204,3 +335,270 @@ extension_implies_text(const char *extension)
 	}
 	return extension_implies_markdown(extension);
 }
+
+/* Whether the file in dir_fd exists and holds exactly the given bytes */
+bool
+file_has_contents_at(int dir_fd,
+                     const char *file_name,
+                     const char *buf,
+                     size_t len)
+{
+    int fd = openat(dir_fd, file_name, O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) != 0 || statbuf.st_size != (off_t) len) {
+        close(fd);
+        return false;
+    }
+    char chunk[COMPARE_CHUNK_SIZE];
+    size_t offset = 0;
+    ssize_t bytes_read;
+    bool same = true;
+    while (same && (bytes_read = read(fd, chunk, COMPARE_CHUNK_SIZE)) != 0) {
+        if (bytes_read == -1) {
+            same = errno == EINTR;
+            continue;
+        }
+        same = offset + bytes_read <= len
+            && memcmp(chunk, buf + offset, bytes_read) == 0;
+        offset += bytes_read;
+    }
+    close(fd);
+    return same && offset == len;
+}
+
+bool
+file_has_contents(const char *file_name, const char *buf, size_t len)
+{
+    return file_has_contents_at(AT_FDCWD, file_name, buf, len);
+}
+
+/* Whether both files exist and hold exactly the same bytes */
+bool
+files_have_same_contents(const char *file_name_1, const char *file_name_2)
+{
+    struct stat statbuf_1;
+    struct stat statbuf_2;
+    if (stat(file_name_1, &statbuf_1) != 0
+        || stat(file_name_2, &statbuf_2) != 0
+        || statbuf_1.st_size != statbuf_2.st_size) {
+        return false;
+    }
+    FILE *fp_1 = fopen(file_name_1, "rb");
+    FILE *fp_2 = fopen(file_name_2, "rb");
+    bool same = fp_1 != NULL && fp_2 != NULL;
+    char chunk_1[COMPARE_CHUNK_SIZE];
+    char chunk_2[COMPARE_CHUNK_SIZE];
+    while (same) {
+        size_t bytes_read = fread(chunk_1, 1, COMPARE_CHUNK_SIZE, fp_1);
+        same = fread(chunk_2, 1, COMPARE_CHUNK_SIZE, fp_2) == bytes_read
+            && memcmp(chunk_1, chunk_2, bytes_read) == 0;
+        if (bytes_read < COMPARE_CHUNK_SIZE) {
+            same = same && !ferror(fp_1) && !ferror(fp_2);
+            break;
+        }
+    }
+    if (fp_1 != NULL) {
+        fclose(fp_1);
+    }
+    if (fp_2 != NULL) {
+        fclose(fp_2);
+    }
+    return same;
+}
+
+/*
+ * Write the bytes to the file in dir_fd unless it already holds them, so that
+ * an output which has not changed keeps its mtime.
+ */
+enum file_change
+write_file_if_changed_at(int dir_fd,
+                         const char *file_name,
+                         const char *buf,
+                         size_t len)
+{
+    if (file_has_contents_at(dir_fd, file_name, buf, len)) {
+        return FILE_UNCHANGED;
+    }
+    bool existed = faccessat(dir_fd, file_name, F_OK, 0) == 0;
+    int fd = openat(dir_fd, file_name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd == -1) {
+        fprintf(stderr, "ERROR: Could not open for writing: %s\n", file_name);
+        abort();
+    }
+    size_t written = 0;
+    while (written < len) {
+        ssize_t n = write(fd, buf + written, len - written);
+        if (n == -1 && errno != EINTR) {
+            break;
+        } else if (n > 0) {
+            written += n;
+        }
+    }
+    if (written < len || close(fd) != 0) {
+        fprintf(stderr, "ERROR: Could not write %s\n", file_name);
+        abort();
+    }
+    return existed ? FILE_MODIFIED : FILE_ADDED;
+}
+
+enum file_change
+write_file_if_changed(const char *file_name, const char *buf, size_t len)
+{
+    return write_file_if_changed_at(AT_FDCWD, file_name, buf, len);
+}
+
+/*
+ * Put a freshly built directory in place of the one being served, leaving
+ * the old one where the new one was. Both are swapped in one atomic step
+ * where the system supports it, so nothing ever sees the directory missing or
+ * half built.
+ */
+bool
+swap_directories(const char *dir_name, const char *target_dir_name)
+{
+    if (access(target_dir_name, F_OK) != 0) {
+        return rename(dir_name, target_dir_name) == 0;
+    }
+#if defined(HAVE_RENAMEAT2) && defined(RENAME_EXCHANGE)
+    if (renameat2(AT_FDCWD, dir_name,
+                  AT_FDCWD, target_dir_name,
+                  RENAME_EXCHANGE) == 0) {
+        return true;
+    }
+    if (errno != ENOSYS && errno != EINVAL) {
+        return false;
+    }
+#endif /* HAVE_RENAMEAT2 && RENAME_EXCHANGE */
+
+    /* Fall back on three renames, with a moment in which there is none */
+    char *tmp_dir_name;
+    if (asprintf(&tmp_dir_name, "%s.old", target_dir_name) == -1) {
+        fprintf(stderr, "ERROR: Could not asprintf() directory name\n");
+        abort();
+    }
+    bool ok = rename(target_dir_name, tmp_dir_name) == 0;
+    if (ok && rename(dir_name, target_dir_name) != 0) {
+        rename(tmp_dir_name, target_dir_name);
+        ok = false;
+    }
+    if (ok) {
+        rename(tmp_dir_name, dir_name);
+    }
+    free(tmp_dir_name);
+    return ok;
+}
+
+#ifdef HAVE_COPY_FILE_RANGE
+static bool
+copy_with_copy_file_range(int in_fd, int out_fd, off_t *offset_ptr)
+{
+    while (true) {
+        loff_t in_offset = *offset_ptr;
+        loff_t out_offset = *offset_ptr;
+        ssize_t copied = copy_file_range(in_fd, &in_offset,
+                                         out_fd, &out_offset,
+                                         COPY_KERNEL_CHUNK_SIZE, 0);
+        if (copied == 0) {
+            return true;
+        } else if (copied == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        *offset_ptr += copied;
+    }
+}
+#endif /* HAVE_COPY_FILE_RANGE */
+
+#if defined(HAVE_SENDFILE) && defined(HAVE_SYS_SENDFILE_H)
+static bool
+copy_with_sendfile(int in_fd, int out_fd, off_t *offset_ptr)
+{
+    /* sendfile() writes at the output's file position */
+    if (lseek(out_fd, *offset_ptr, SEEK_SET) == -1) {
+        return false;
+    }
+    while (true) {
+        ssize_t copied = sendfile(out_fd,
+                                  in_fd,
+                                  offset_ptr,
+                                  COPY_KERNEL_CHUNK_SIZE);
+        if (copied == 0) {
+            return true;
+        } else if (copied == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+    }
+}
+#endif /* HAVE_SENDFILE && HAVE_SYS_SENDFILE_H */
+
+static bool
+copy_with_buffer(int in_fd, int out_fd, off_t *offset_ptr)
+{
+    void *buf;
+    if (posix_memalign(&buf, COPY_BUFFER_ALIGNMENT, COPY_BUFFER_SIZE) != 0) {
+        fprintf(stderr, "ERROR: Could not allocate copy buffer\n");
+        abort();
+    }
+    bool ok = true;
+    while (ok) {
+        ssize_t bytes_read = pread(in_fd, buf, COPY_BUFFER_SIZE, *offset_ptr);
+        if (bytes_read == 0) {
+            break;
+        } else if (bytes_read == -1) {
+            ok = errno == EINTR;
+            continue;
+        }
+        ssize_t bytes_written = 0;
+        while (ok && bytes_written < bytes_read) {
+            ssize_t n = pwrite(out_fd,
+                               (char *) buf + bytes_written,
+                               bytes_read - bytes_written,
+                               *offset_ptr + bytes_written);
+            if (n == -1) {
+                ok = errno == EINTR;
+                continue;
+            }
+            bytes_written += n;
+        }
+        *offset_ptr += bytes_written;
+    }
+    free(buf);
+    return ok;
+}
+
+/*
+ * Copy all of in_fd into the empty file out_fd, as cheaply as the system
+ * allows: by sharing the blocks where the filesystem can, else within the
+ * kernel, else through one large buffer. A way that fails part way hands on
+ * to the next from where it got to.
+ */
+bool
+copy_file_data(int in_fd, int out_fd)
+{
+#if defined(HAVE_LINUX_FS_H) && defined(FICLONE)
+    if (ioctl(out_fd, FICLONE, in_fd) == 0) {
+        return true;
+    }
+#endif /* HAVE_LINUX_FS_H && FICLONE */
+
+    off_t offset = 0;
+#ifdef HAVE_COPY_FILE_RANGE
+    if (copy_with_copy_file_range(in_fd, out_fd, &offset)) {
+        return true;
+    }
+#endif /* HAVE_COPY_FILE_RANGE */
+#if defined(HAVE_SENDFILE) && defined(HAVE_SYS_SENDFILE_H)
+    if (copy_with_sendfile(in_fd, out_fd, &offset)) {
+        return true;
+    }
+#endif /* HAVE_SENDFILE && HAVE_SYS_SENDFILE_H */
+    return copy_with_buffer(in_fd, out_fd, &offset);
+}
@@ -5,7 +5,7 @@
  */
 
 /*
- * Copyright (c) 2016-2020 David Jackson
+ * Copyright (c) 2016-2026 David Jackson
  */
 
 #ifndef FILES_H
@@ -13,19 +13,49 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <sys/types.h>
+#include "arena.h"
+
+/* What writing an output did to it */
+enum file_change {
+    FILE_UNCHANGED,
+    FILE_ADDED,
+    FILE_MODIFIED,
+    FILE_DELETED
+};
+
+/* The contents of a file, as given by map_file() */
+struct mapped_file {
+    const char *data;
+    size_t len;
+    bool is_mapped;
+};
 
 void
 get_file_list(const char *dir_name,
               char ***file_names_ptr,
+              off_t **file_sizes_ptr,
+              time_t **file_mtimes_ptr,
               int *num_files_ptr, 
               char ***directories_ptr,
               int *num_directories_ptr);
 
 char
-*file_extension(const char *file_name);
+*file_extension(const char *file_name, struct arena *arena);
 
 char
-*read_file_contents(FILE *fp);
+*read_file(const char *file_name, size_t *len_ptr);
+
+bool
+map_file(const char *file_name, struct mapped_file *mf);
+
+void
+unmap_file(struct mapped_file *mf);
+
+bool
+map_file_or_take(const char *file_name,
+                 struct mapped_file *kept,
+                 struct mapped_file *mf);
 
 bool
 extension_implies_markdown(const char *extension);
@@ -33,6 +63,33 @@ extension_implies_markdown(const char *extension);
 bool
 extension_implies_text(const char *extension);
 
+bool
+file_has_contents(const char *file_name, const char *buf, size_t len);
+
+bool
+file_has_contents_at(int dir_fd,
+                     const char *file_name,
+                     const char *buf,
+                     size_t len);
+
+bool
+copy_file_data(int in_fd, int out_fd);
+
+bool
+swap_directories(const char *dir_name, const char *target_dir_name);
+
+bool
+files_have_same_contents(const char *file_name_1, const char *file_name_2);
+
+enum file_change
+write_file_if_changed(const char *file_name, const char *buf, size_t len);
+
+enum file_change
+write_file_if_changed_at(int dir_fd,
+                         const char *file_name,
+                         const char *buf,
+                         size_t len);
+
 #ifndef HAVE_BASENAME_R
 char
 *basename_r(const char *path, char *bname);
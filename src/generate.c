@@ -5,137 +5,1039 @@
  */
 
 /*
- * Copyright (c) 2017-2021 David Jackson
+ * Copyright (c) 2017-2026 David Jackson
  */
 
 #include "config.h"
 
+#include "common.h"
 #include "generate.h"
 #include "processing.h"
-#include "files.h"
 #include "layout.h"
+#include "inventory.h"
+#include "work_queue.h"
+#include "scheduler.h"
+#include "pipeline.h"
+#include "files.h"
+#include "render.h"
+#include "string_util.h"
+#include "cytogen_header.h"
+#include "manifest.h"
+#include "hash.h"
+#include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <time.h>
 #include <sys/stat.h>
+#include <dirent.h>
+#include <pthread.h>
+
+/*
+ * Most text files kept mapped between being checked and being rendered, well
+ * under the default limit of 65530 mappings a Linux process may have. Past
+ * it, files are mapped again to render them.
+ */
+#define MAX_KEPT_SOURCES 16384
 
 /*
- * Used to sort file names of posts in reverse-alphanumeric order so that the
- * files sort most-recent to least-recent by date.
+ * Used to sort the inventory largest-file-first so that the files that take
+ * longest to process are started first instead of holding up the end of the
+ * pass. Files of equal size fall back to reverse-alphanumeric order.
  */
 static int
-file_name_compare(const void *file_name_1, const void *file_name_2)
+entry_compare(const void *entry_1, const void *entry_2)
 {
-    const char **fname1_ptr = (const char **) file_name_1;
-    const char **fname2_ptr = (const char **) file_name_2;
-    int strcmp_retval = strcmp(*fname1_ptr, *fname2_ptr);
+    const struct inventory_entry *e1 = (const struct inventory_entry *) entry_1;
+    const struct inventory_entry *e2 = (const struct inventory_entry *) entry_2;
+    if (e1->size != e2->size) {
+        return e1->size > e2->size ? -1 : 1;
+    }
+    int strcmp_retval = strcmp(e1->in_path, e2->in_path);
     return strcmp_retval * -1;
 }
 
-/* Set up the threads to process files, process them, tear down threads */
+/*
+ * Whether the named layout or any layout it extends refers to the posts. The
+ * walk up the graph is limited to num_layouts steps, as a cycle would never
+ * end.
+ */
+static bool
+layout_chain_uses_posts(struct layout *layouts,
+                        int num_layouts,
+                        const char *name)
+{
+    int steps;
+    for (steps = 0; name != NULL && steps <= num_layouts; steps++) {
+        struct layout *layout = layout_find(layouts, num_layouts, name);
+        if (layout == NULL) {
+            break;
+        }
+        if (template_references(layout->content,
+                                strlen(layout->content),
+                                POSTS_KEY)) {
+            return true;
+        }
+        name = layout->parent;
+    }
+    return false;
+}
+
+/*
+ * Read what a text file depends on from its header, given its contents: the
+ * layout it uses, if any, and whether it consumes the posts collection,
+ * either directly or through any layout in its chain. Pages that use the
+ * posts have to wait for the posts pass to finish.
+ */
 static void
-_generate(int num_workers,
-          const char *site_dir,
-          int num_files,
-          char **file_names,
-          struct layout *layouts,
-          int num_layouts,
-          ctache_data_t *data,
-          pthread_mutex_t *data_mutex,
-          void *(*process)(void*))
+entry_read_dependencies(const struct mapped_file *source,
+                        struct layout *layouts,
+                        int num_layouts,
+                        char **layout_name_ptr,
+                        bool *uses_posts_ptr)
 {
-    int files_per_worker = num_files / num_workers;
-    pthread_t *thr_pool = malloc(sizeof(pthread_t) * num_workers);
-    size_t arr_size = sizeof(struct process_file_args) * num_workers;
-    struct process_file_args *threads_args = malloc(arr_size);
+    bool uses_posts = false;
+    char *layout_name = NULL;
 
-    /* Create workers */
-    int i;
-    for (i = 0; i < num_workers; i++) {
-        threads_args[i].start_index = i * files_per_worker;
-        if (i + 1 < num_workers) {
-            threads_args[i].end_index = threads_args[i].start_index
-                + files_per_worker;
+    ctache_data_t *header_data = ctache_data_create_hash();
+    size_t header_len = cytogen_header_read_from_span(source->data,
+                                                      source->len,
+                                                      header_data,
+                                                      NULL);
+    if (header_len > source->len) {
+        header_len = source->len;
+    }
+    uses_posts = template_references(source->data + header_len,
+                                     source->len - header_len,
+                                     POSTS_KEY);
+    if (ctache_data_hash_table_has_key(header_data, LAYOUT)) {
+        ctache_data_t *layout_data;
+        layout_data = ctache_data_hash_table_get(header_data, LAYOUT);
+        const char *layout_str = ctache_data_string_buffer(layout_data);
+        layout_name = string_trim(layout_str, NULL);
+        if (!uses_posts) {
+            uses_posts = layout_chain_uses_posts(layouts,
+                                                 num_layouts,
+                                                 layout_name);
+        }
+    }
+
+    ctache_data_destroy(header_data);
+
+    *layout_name_ptr = layout_name;
+    *uses_posts_ptr = uses_posts;
+}
+
+/*
+ * Hash of what every text file is rendered with besides its own contents and
+ * its layouts: the config, and cyto itself. Where the running executable can
+ * be found, its size and modification time stand for it, so that a cyto
+ * rebuilt without a change of version does not reuse what the old one made.
+ */
+static uint64_t
+environment_hash(void)
+{
+    uint64_t hash = hash_string(HASH_INIT, PACKAGE_VERSION);
+    struct stat statbuf;
+    if (stat("/proc/self/exe", &statbuf) == 0) {
+        hash = hash_bytes(hash, &(statbuf.st_size), sizeof(statbuf.st_size));
+        hash = hash_bytes(hash, &(statbuf.st_mtime), sizeof(statbuf.st_mtime));
+    }
+    uint64_t config_hash;
+    if (hash_file(CONFIG_FILE_NAME, &config_hash)) {
+        hash = hash_bytes(hash, &config_hash, sizeof(config_hash));
+    }
+    return hash;
+}
+
+/*
+ * Determine whether an entry's contents are the same as at the last build,
+ * filling in its hash. The contents are only hashed if the size and the
+ * modification time are not enough to tell. A file modified in the same
+ * second as the last build started may have changed since, so it is hashed.
+ * Unless must_hash is set, a file that is new or has changed size is not
+ * hashed at all, since it has changed either way: it is left with a hash of 0
+ * for the worker that processes it to fill in. Given a source, the file is
+ * hashed by mapping it there, so that the mapping can be used again.
+ */
+static bool
+entry_unchanged(struct inventory_entry *entry,
+                struct manifest_entry *old_entry,
+                time_t old_build_time,
+                bool must_hash,
+                struct mapped_file *source)
+{
+    if (old_entry != NULL
+        && old_entry->size == entry->size
+        && old_entry->mtime == entry->mtime
+        && entry->mtime < old_build_time) {
+        entry->hash = old_entry->hash;
+        return true;
+    }
+    entry->hash = 0;
+    if (!must_hash && (old_entry == NULL || old_entry->size != entry->size)) {
+        return false;
+    }
+    if (source != NULL) {
+        if (!map_file(entry->in_path, source)) {
+            source->data = NULL;
+            return false;
+        }
+        entry->hash = hash_bytes(HASH_INIT, source->data, source->len);
+    } else if (!hash_file(entry->in_path, &(entry->hash))) {
+        entry->hash = 0;
+        return false;
+    }
+    return old_entry != NULL
+        && old_entry->size == entry->size
+        && old_entry->hash == entry->hash;
+}
+
+/* What checking the entries against the last build needs */
+struct build_check {
+    struct manifest *old_manifest;
+    struct manifest *manifest;
+    struct layout *layouts;
+    int num_layouts;
+    bool same_posts; /* The posts are the same as at the last build */
+    bool defer_posts_pages; /* Leave the pages that use the posts unbuilt */
+    const char *site_dir;
+    enum asset_mode assets;
+    int num_kept_sources; /* Text files kept mapped for their workers */
+    pthread_mutex_t mutex;
+};
+
+/* An entry as the check pass found it, before it is recorded */
+struct checked_entry {
+    struct inventory_entry *entry;
+    struct manifest_entry *old_entry;
+    bool is_post;
+    bool is_text;
+    bool unchanged; /* Its contents are the same as at the last build */
+    bool has_output; /* Its output from the last build is still there */
+    char *out_file_name;
+    char *layout_name;
+    bool uses_posts;
+    uint64_t deps;
+    int manifest_index; /* Its entry in the new manifest, or -1 */
+};
+
+/*
+ * Outputs are recorded relative to the site directory, so that the manifest
+ * still holds when the directory is renamed, as it is by a staged build.
+ */
+static const char
+*site_relative_path(const char *path, const char *site_dir)
+{
+    size_t site_dir_len = strlen(site_dir);
+    if (strncmp(path, site_dir, site_dir_len) == 0
+        && path[site_dir_len] == '/') {
+        return path + site_dir_len + 1;
+    }
+    return path;
+}
+
+/* Hash of the config and of the chain of layouts a text file uses */
+static uint64_t
+entry_deps(struct build_check *check, const char *layout_name)
+{
+    if (layout_name != NULL && layout_name[0] == '\0') {
+        layout_name = NULL;
+    }
+    uint64_t hash = layout_dependency_hash(check->layouts,
+                                           check->num_layouts,
+                                           layout_name);
+    return hash_bytes(hash, &(check->manifest->env), sizeof(uint64_t));
+}
+
+/*
+ * Keep a text file mapped from checking it for the worker that renders it,
+ * so that it is read only once, unless that would keep too many mapped.
+ */
+static void
+entry_keep_source(struct build_check *check, struct inventory_entry *entry)
+{
+    bool keep = false;
+    if (entry->source.data != NULL && entry->source.is_mapped) {
+        pthread_mutex_lock(&(check->mutex));
+        keep = check->num_kept_sources < MAX_KEPT_SOURCES;
+        if (keep) {
+            check->num_kept_sources++;
+        }
+        pthread_mutex_unlock(&(check->mutex));
+    }
+    if (!keep && entry->source.data != NULL) {
+        unmap_file(&(entry->source));
+    }
+}
+
+/*
+ * Do the part of checking an entry that reads the file system, which is run
+ * by the workers of the check pass. An unchanged file is not read at all: its
+ * edge in the layout graph comes from the manifest. The posts are always
+ * hashed, since the pages that list them depend on their hashes. A text file
+ * that has to be read is hashed and has its dependencies read from one
+ * mapping, which is then kept for rendering it.
+ */
+static void
+entry_inspect(struct build_check *check, struct checked_entry *checked)
+{
+    struct inventory_entry *entry = checked->entry;
+    struct manifest_entry *old_entry = checked->old_entry;
+    char *extension = file_extension(entry->in_path, NULL);
+    checked->is_text = extension_implies_text(extension);
+    free(extension);
+    checked->unchanged = entry_unchanged(entry,
+                                         old_entry,
+                                         check->old_manifest->build_time,
+                                         checked->is_text || checked->is_post,
+                                         checked->is_text
+                                             ? &(entry->source)
+                                             : NULL);
+
+    /*
+     * Binary files are published as they are, so they only need themselves
+     * and, to republish them when it changes, the way they are published
+     */
+    checked->layout_name = NULL;
+    checked->uses_posts = false;
+    checked->deps = 0;
+    if (checked->is_text) {
+        bool same_deps = false;
+        if (checked->unchanged) {
+            checked->deps = entry_deps(check, old_entry->layout);
+            same_deps = checked->deps == old_entry->deps;
+        }
+        if (same_deps) {
+            checked->layout_name = strdup(old_entry->layout);
+            checked->uses_posts = old_entry->flags & MANIFEST_USES_POSTS;
         } else {
-            threads_args[i].end_index = num_files;
+            if (entry->source.data == NULL
+                && !map_file(entry->in_path, &(entry->source))) {
+                entry->source.data = NULL;
+            }
+            if (entry->source.data != NULL) {
+                entry_read_dependencies(&(entry->source),
+                                        check->layouts,
+                                        check->num_layouts,
+                                        &(checked->layout_name),
+                                        &(checked->uses_posts));
+            }
+            checked->deps = entry_deps(check, checked->layout_name);
         }
-        threads_args[i].file_names = file_names;
-        threads_args[i].data = data;
-        threads_args[i].data_mutex = data_mutex;
-        threads_args[i].layouts = layouts;
-        threads_args[i].num_layouts = num_layouts;
-        threads_args[i].site_dir = site_dir;
-        pthread_create(&(thr_pool[i]), NULL, process, &(threads_args[i]));
+        entry_keep_source(check, entry);
+    } else if (check->assets != ASSETS_COPY) {
+        checked->deps = hash_bytes(HASH_INIT,
+                                   &(check->assets),
+                                   sizeof(check->assets));
     }
+    checked->uses_posts = checked->uses_posts && !checked->is_post;
+
+    struct stat statbuf;
+    checked->out_file_name = final_out_file_name(entry->in_path,
+                                                 entry->site_dir,
+                                                 checked->is_post,
+                                                 NULL);
+    checked->has_output = stat(checked->out_file_name, &statbuf) == 0;
+}
+
+/* What the workers of the check pass share */
+struct check_pass {
+    struct build_check *check;
+    struct work_queue queue;
+};
 
-    /* Wait for workers to finish */
+static void
+*check_files(void *pass_ptr)
+{
+    struct check_pass *pass = (struct check_pass *) pass_ptr;
+    struct checked_entry *checked;
+    while ((checked = work_queue_next(&(pass->queue))) != NULL) {
+        entry_inspect(pass->check, checked);
+    }
+    return NULL;
+}
+
+/*
+ * Inspect the entries on the thread pool, so that the files that have to be
+ * read to be checked are read in parallel.
+ */
+static void
+check_pass_run(struct build_check *check,
+               struct thread_pool *pool,
+               struct checked_entry *checked_entries,
+               int num_checked)
+{
+    struct check_pass pass;
+    void **items = malloc(sizeof(void *) * (num_checked + 1));
+    if (items == NULL) {
+        fprintf(stderr, "ERROR: Could not malloc() for check pass\n");
+        abort();
+    }
+    int i;
+    for (i = 0; i < num_checked; i++) {
+        items[i] = &(checked_entries[i]);
+    }
+    pass.check = check;
+    work_queue_init(&(pass.queue), items, num_checked);
+    int num_workers = pool->num_threads;
+    if (num_workers > num_checked) {
+        num_workers = num_checked;
+    }
     for (i = 0; i < num_workers; i++) {
-        pthread_join(thr_pool[i], NULL);
+        thread_pool_submit(pool, check_files, &pass);
+    }
+    thread_pool_wait(pool);
+    work_queue_destroy(&(pass.queue));
+    free(items);
+}
+
+/*
+ * Finish checking an inspected entry against the last build and record it in
+ * the new manifest. It is up to date if its contents, the config and the
+ * layouts in its chain are all unchanged, as are the posts if it uses them,
+ * and its output is still there.
+ */
+static void
+entry_check(struct build_check *check, struct checked_entry *checked)
+{
+    struct inventory_entry *entry = checked->entry;
+    struct manifest_entry *old_entry = checked->old_entry;
+
+    /* The output is rendered from exactly what it depends on */
+    entry->cache_key.hash = 0;
+    if (checked->is_text && entry->hash != 0) {
+        cache_key_init(&(entry->cache_key),
+                       entry->in_path,
+                       entry->hash,
+                       checked->deps,
+                       checked->uses_posts ? check->manifest->posts : 0);
     }
 
-    /* Threads Cleanup */
-    free(threads_args);
-    free(thr_pool);
+    const char *out_path = site_relative_path(checked->out_file_name,
+                                              check->site_dir);
+    entry->source_changed = !checked->unchanged;
+    entry->up_to_date = checked->unchanged
+        && old_entry->deps == checked->deps
+        && (!checked->uses_posts || check->same_posts)
+        && strcmp(old_entry->out_path, out_path) == 0
+        && checked->has_output;
+
+    /* Only what is rendered needs its contents kept */
+    if (entry->source.data != NULL
+        && (entry->up_to_date
+            || (checked->uses_posts && check->defer_posts_pages))) {
+        unmap_file(&(entry->source));
+    }
+    checked->manifest_index = -1;
+    if (!(checked->uses_posts && check->defer_posts_pages)) {
+        checked->manifest_index = check->manifest->num_entries;
+        manifest_add(check->manifest,
+                     entry->in_path,
+                     out_path,
+                     entry->size,
+                     entry->mtime,
+                     entry->hash,
+                     checked->deps,
+                     checked->layout_name,
+                     checked->uses_posts ? MANIFEST_USES_POSTS : 0);
+    }
 }
-    
+
+static bool
+is_directory(const char *path)
+{
+    struct stat statbuf;
+    return stat(path, &statbuf) == 0 && S_ISDIR(statbuf.st_mode);
+}
+
+static int
+out_path_compare(const void *path_1, const void *path_2)
+{
+    return strcmp(*(const char **) path_1, *(const char **) path_2);
+}
+
+/*
+ * Whether an output path read from a manifest stays inside the site directory.
+ * The manifest is only a file in the site, so it is not trusted to.
+ */
+static bool
+out_path_is_safe(const char *out_path)
+{
+    if (out_path[0] == '\0' || out_path[0] == '/') {
+        return false;
+    }
+    const char *component = out_path;
+    while (component != NULL) {
+        const char *slash = strchr(component, '/');
+        size_t len = slash != NULL ? (size_t) (slash - component)
+                                   : strlen(component);
+        if (len == 2 && strncmp(component, "..", 2) == 0) {
+            return false;
+        }
+        component = slash != NULL ? slash + 1 : NULL;
+    }
+    return true;
+}
+
+/*
+ * Remove the outputs of the files that are gone since the last build, along
+ * with any site directories that leaves empty, unless they mirror source
+ * directories that are still there, as a build from scratch would make them.
+ * An output that a file of this
+ * build also writes to, e.g. that of a post whose extension was changed, is
+ * not stale.
+ */
+static void
+remove_stale_outputs(struct manifest *old_manifest,
+                     struct manifest *manifest,
+                     const char *site_dir,
+                     struct changes *changes)
+{
+    size_t site_dir_len = strlen(site_dir);
+    int i;
+
+    const char **out_paths = malloc(sizeof(char *)
+                                    * (manifest->num_entries + 1));
+    if (out_paths == NULL) {
+        fprintf(stderr, "ERROR: Could not malloc() for output paths\n");
+        abort();
+    }
+    for (i = 0; i < manifest->num_entries; i++) {
+        out_paths[i] = manifest->entries[i].out_path;
+    }
+    qsort(out_paths, manifest->num_entries, sizeof(char *), out_path_compare);
+
+    for (i = 0; i < old_manifest->num_entries; i++) {
+        struct manifest_entry *old_entry = &(old_manifest->entries[i]);
+        if (manifest_find(manifest, old_entry->in_path) != NULL
+            || !out_path_is_safe(old_entry->out_path)
+            || bsearch(&(old_entry->out_path),
+                       out_paths,
+                       manifest->num_entries,
+                       sizeof(char *),
+                       out_path_compare) != NULL) {
+            continue;
+        }
+        char *dir;
+        asprintf(&dir, "%s/%s", site_dir, old_entry->out_path);
+        if (unlink(dir) == -1) {
+            free(dir);
+            continue;
+        }
+        changes_record(changes, FILE_DELETED, dir, 0);
+
+        char *slash;
+        while ((slash = strrchr(dir, '/')) != NULL
+               && (size_t) (slash - dir) > site_dir_len) {
+            *slash = '\0';
+            if (is_directory(dir + site_dir_len + 1) || rmdir(dir) == -1) {
+                break;
+            }
+        }
+        free(dir);
+    }
+    free(out_paths);
+}
+
+/* Files are spread over the shards by a hash of their paths */
+static bool
+entry_in_shard(struct generate_arguments *args, struct inventory_entry *entry)
+{
+    if (args->num_shards < 1) {
+        return true;
+    }
+    uint64_t hash = hash_string(HASH_INIT, entry->in_path);
+    return hash % args->num_shards == (uint64_t) args->shard;
+}
+
+/*
+ * A set of files that is processed in parallel by the workers of the pool,
+ * each of which pulls files from the pass's shared queue.
+ */
+struct pass {
+    void **entries;
+    int num_entries;
+    struct work_queue queue;
+    struct process_file_args *workers_args;
+    void **job_args;
+    int num_workers;
+    bool scheduled;
+};
+
+static void
+pass_init(struct pass *pass,
+          int num_entries,
+          struct generate_arguments *args,
+          struct layout *layouts,
+          int num_layouts)
+{
+    pass->entries = malloc(sizeof(void *) * (num_entries > 0 ? num_entries : 1));
+    pass->num_entries = 0;
+    pass->num_workers = args->pool->num_threads;
+    pass->scheduled = false;
+    size_t arr_size = sizeof(struct process_file_args) * args->pool->num_threads;
+    pass->workers_args = malloc(arr_size);
+    pass->job_args = malloc(sizeof(void *) * args->pool->num_threads);
+
+    int i;
+    for (i = 0; i < args->pool->num_threads; i++) {
+        pass->workers_args[i].queue = &(pass->queue);
+        pass->workers_args[i].data = args->data;
+        pass->workers_args[i].data_mutex = args->data_mutex;
+        pass->workers_args[i].layouts = layouts;
+        pass->workers_args[i].num_layouts = num_layouts;
+        pass->workers_args[i].site_dir = NULL;
+        pass->workers_args[i].entry = NULL;
+        pass->workers_args[i].cache = args->cache;
+        pass->workers_args[i].cache_key = NULL;
+        pass->workers_args[i].is_post = false;
+        pass->workers_args[i].changes = args->changes;
+        pass->workers_args[i].assets = args->assets;
+        pass->workers_args[i].dirs = args->dirs;
+        arena_init(&(pass->workers_args[i].arena));
+        pass->job_args[i] = &(pass->workers_args[i]);
+    }
+}
+
+static void
+pass_add(struct pass *pass, struct inventory_entry *entry)
+{
+    pass->entries[pass->num_entries] = entry;
+    pass->num_entries++;
+}
+
+/* Add the pass to the scheduler as a task with one job per worker */
+static struct sched_task
+*pass_schedule(struct pass *pass,
+               struct scheduler *scheduler,
+               void *(*process)(void*))
+{
+    work_queue_init(&(pass->queue), pass->entries, pass->num_entries);
+    pass->scheduled = true;
+    if (pass->num_workers > pass->num_entries) {
+        pass->num_workers = pass->num_entries;
+    }
+    return scheduler_add_task(scheduler,
+                              process,
+                              pass->job_args,
+                              pass->num_workers);
+}
+
+static void
+pass_destroy(struct pass *pass)
+{
+    if (pass->scheduled) {
+        work_queue_destroy(&(pass->queue));
+    }
+    int i;
+    for (i = 0; i < pass->num_workers; i++) {
+        arena_destroy(&(pass->workers_args[i].arena));
+    }
+    free(pass->job_args);
+    free(pass->workers_args);
+    free(pass->entries);
+}
+
+/* Run the passes as tasks on the thread pool, ordered by their dependencies */
+static void
+generate_scheduled(struct generate_arguments *args,
+                   struct pass *posts_pass,
+                   struct pass *pages_pass,
+                   struct pass *posts_pages_pass)
+{
+    struct scheduler scheduler;
+    struct sched_task *posts_task;
+    struct sched_task *finish_posts_task;
+    struct sched_task *posts_pages_task;
+    bool has_posts = args->posts_dir_name != NULL;
+
+    /* Build the dependency graph, posts first since they gate the most work */
+    scheduler_init(&scheduler, args->pool);
+    posts_task = pass_schedule(posts_pass, &scheduler, process_post_files);
+    finish_posts_task = scheduler_add_task(&scheduler,
+                                           args->finish_posts,
+                                           &(args->finish_posts_arg),
+                                           has_posts ? 1 : 0);
+    scheduler_add_dependency(finish_posts_task, posts_task);
+    pass_schedule(pages_pass, &scheduler, process_files);
+    posts_pages_task = pass_schedule(posts_pages_pass,
+                                     &scheduler,
+                                     process_files);
+    scheduler_add_dependency(posts_pages_task, finish_posts_task);
+
+    scheduler_run(&scheduler);
+    scheduler_destroy(&scheduler);
+}
+
+/*
+ * Run the passes through the staged pipeline: the posts and every page that
+ * does not use them first, then the pages that do once the posts are done.
+ */
+static void
+generate_pipelined(struct generate_arguments *args,
+                   struct pass *posts_pass,
+                   struct pass *pages_pass,
+                   struct pass *posts_pages_pass,
+                   struct layout *layouts,
+                   int num_layouts)
+{
+    struct pipeline_arguments pipeline_args;
+    pipeline_args.data = args->data;
+    pipeline_args.data_mutex = args->data_mutex;
+    pipeline_args.layouts = layouts;
+    pipeline_args.num_layouts = num_layouts;
+    pipeline_args.num_io_workers = args->num_io_workers;
+    pipeline_args.num_cpu_workers = args->pool->num_threads;
+    pipeline_args.cache = args->cache;
+    pipeline_args.changes = args->changes;
+    pipeline_args.assets = args->assets;
+    pipeline_args.dirs = args->dirs;
+
+    pipeline_args.posts = (struct inventory_entry **) posts_pass->entries;
+    pipeline_args.num_posts = posts_pass->num_entries;
+    pipeline_args.pages = (struct inventory_entry **) pages_pass->entries;
+    pipeline_args.num_pages = pages_pass->num_entries;
+    pipeline_run(&pipeline_args);
+
+    if (args->posts_dir_name != NULL) {
+        args->finish_posts(args->finish_posts_arg);
+    }
+
+    pipeline_args.posts = NULL;
+    pipeline_args.num_posts = 0;
+    pipeline_args.pages = (struct inventory_entry **) posts_pages_pass->entries;
+    pipeline_args.num_pages = posts_pages_pass->num_entries;
+    pipeline_run(&pipeline_args);
+}
+
+/*
+ * Scan the site's posts, if it has any, and its pages into inventories sorted
+ * largest-first.
+ */
+void
+generate_scan(const char *curr_dir_name,
+              const char *posts_dir_name,
+              const char *site_dir,
+              struct inventory *posts_inventory,
+              struct inventory *pages_inventory)
+{
+    inventory_init(posts_inventory);
+    if (posts_dir_name != NULL) {
+        inventory_scan(posts_inventory, posts_dir_name, site_dir);
+    }
+    qsort(posts_inventory->entries,
+          posts_inventory->num_entries,
+          sizeof(struct inventory_entry),
+          entry_compare);
+
+    inventory_init(pages_inventory);
+    inventory_scan(pages_inventory, curr_dir_name, site_dir);
+    qsort(pages_inventory->entries,
+          pages_inventory->num_entries,
+          sizeof(struct inventory_entry),
+          entry_compare);
+}
+
+/*
+ * Scan the whole site into inventories first, unless the caller already has,
+ * then process everything in one scheduled run. Posts are processed alongside
+ * every page and asset that does not use the posts collection; only the pages
+ * that do use it wait for the posts to be finished.
+ *
+ * A sharded build only processes its own share of the files, leaving the
+ * pages that use the posts to generate_merge(), and records what it did in a
+ * manifest of its own.
+ */
 void
 generate(struct generate_arguments *args)
 {
-    const char *site_dir;
-    const char *curr_dir_name;
-    char **file_names;
-    int num_files;
-    char **directories;
-    int num_directories;
-
-    get_file_list(args->curr_dir_name,
-                  &file_names,
-                  &num_files,
-                  &directories,
-                  &num_directories);
-    qsort(file_names, num_files, sizeof(char *), file_name_compare);
+    struct inventory scanned_posts_inventory;
+    struct inventory scanned_pages_inventory;
+    struct inventory *posts_inventory = args->posts_inventory;
+    struct inventory *pages_inventory = args->pages_inventory;
     int num_layouts;
-    struct layout *layouts = get_layouts(&num_layouts);
+    struct layout *layouts;
+    struct pass posts_pass;
+    struct pass pages_pass;
+    struct pass posts_pages_pass;
+    struct manifest old_manifest;
+    struct manifest manifest;
+    struct build_check check;
+    struct dir_cache dirs;
+    char *manifest_file_name;
+    char *shard_manifest_file_name;
+    bool has_posts = args->posts_dir_name != NULL;
+    bool sharded = args->num_shards > 0;
+    int i;
 
-    site_dir = args->site_dir;
-    curr_dir_name = args->curr_dir_name;
+    /* Anything modified from here on may be missed, so it counts as changed */
+    manifest_init(&manifest);
+    manifest.build_time = time(NULL);
 
-    mkdir(site_dir, 0770);
+    if (posts_inventory == NULL) {
+        posts_inventory = &scanned_posts_inventory;
+        pages_inventory = &scanned_pages_inventory;
+        generate_scan(args->curr_dir_name,
+                      args->posts_dir_name,
+                      args->site_dir,
+                      posts_inventory,
+                      pages_inventory);
+    }
 
-    _generate(args->num_workers,
-              site_dir,
-              num_files,
-              file_names,
-              layouts,
-              num_layouts,
-              args->data,
-              args->data_mutex,
-              args->process);
+    layouts = args->layouts;
+    num_layouts = args->num_layouts;
 
-    /* Process the subdirectories, recursively */
-    int i;
-    for (i = 0; i < num_directories; i++) {
-        char *directory = directories[i];
+    /* Load what the last build did, to skip what it already did */
+    asprintf(&manifest_file_name, "%s/%s", args->site_dir, MANIFEST_FILE_NAME);
+    manifest_init(&old_manifest);
+    manifest_read(&old_manifest, manifest_file_name);
+    manifest.env = environment_hash();
+    check.old_manifest = &old_manifest;
+    check.manifest = &manifest;
+    check.layouts = layouts;
+    check.num_layouts = num_layouts;
+    check.defer_posts_pages = sharded && has_posts;
+    check.site_dir = args->site_dir;
+    check.assets = args->assets;
+    check.num_kept_sources = 0;
+    pthread_mutex_init(&(check.mutex), NULL);
 
-        char *subdir;
-        asprintf(&subdir, "%s/%s", curr_dir_name, directory);
+    /* Each output directory is made once, and then written into by handle */
+    dir_cache_init(&dirs);
+    args->dirs = &dirs;
+    for (i = 0; i < posts_inventory->num_site_dirs; i++) {
+        dir_cache_make(&dirs, posts_inventory->site_dirs[i]);
+    }
+    for (i = 0; i < pages_inventory->num_site_dirs; i++) {
+        dir_cache_make(&dirs, pages_inventory->site_dirs[i]);
+    }
+
+    /*
+     * Check every file of this build against the last one, reading the files
+     * that have to be read in parallel. The last build's entries are looked
+     * up first, since the manifest is sorted by the first lookup.
+     */
+    int num_entries = posts_inventory->num_entries
+        + pages_inventory->num_entries;
+    struct checked_entry *checked_entries;
+    checked_entries = malloc(sizeof(struct checked_entry) * (num_entries + 1));
+    if (checked_entries == NULL) {
+        fprintf(stderr, "ERROR: Could not malloc() for checked entries\n");
+        abort();
+    }
+    int num_checked = 0;
+    int num_checked_posts = 0;
+    for (i = 0; i < num_entries; i++) {
+        bool is_post = i < posts_inventory->num_entries;
+        struct inventory_entry *entry = is_post
+            ? &(posts_inventory->entries[i])
+            : &(pages_inventory->entries[i - posts_inventory->num_entries]);
+        if (!entry_in_shard(args, entry)) {
+            continue;
+        }
+        struct checked_entry *checked = &(checked_entries[num_checked]);
+        checked->entry = entry;
+        checked->old_entry = manifest_find(&old_manifest, entry->in_path);
+        checked->is_post = is_post;
+        checked->manifest_index = -1;
+        num_checked++;
+        if (is_post) {
+            num_checked_posts++;
+        }
+    }
+    check_pass_run(&check, args->pool, checked_entries, num_checked);
+
+    /*
+     * Sort the pages into those that need the posts and those that don't,
+     * leaving out the ones that are up to date. Up-to-date posts still go
+     * through their pass to contribute their data to the posts collection.
+     */
+    pass_init(&posts_pass, posts_inventory->num_entries,
+              args, layouts, num_layouts);
+    pass_init(&pages_pass, pages_inventory->num_entries,
+              args, layouts, num_layouts);
+    pass_init(&posts_pages_pass, pages_inventory->num_entries,
+              args, layouts, num_layouts);
+    manifest.posts = 0;
+    for (i = 0; i < num_checked_posts; i++) {
+        struct inventory_entry *entry = checked_entries[i].entry;
+        entry_check(&check, &(checked_entries[i]));
+
+        /* A shard has no use for the posts collection */
+        if (!(sharded && entry->up_to_date)) {
+            pass_add(&posts_pass, entry);
+        }
+
+        /* Summed so that the order the posts are in doesn't matter */
+        uint64_t post_hash = hash_string(HASH_INIT, entry->in_path);
+        post_hash = hash_bytes(post_hash, &(entry->hash), sizeof(uint64_t));
+        manifest.posts += post_hash;
+    }
+    check.same_posts = manifest.posts == old_manifest.posts;
+    for (i = num_checked_posts; i < num_checked; i++) {
+        struct inventory_entry *entry = checked_entries[i].entry;
+        entry_check(&check, &(checked_entries[i]));
+        bool uses_posts = checked_entries[i].uses_posts;
+        if (entry->up_to_date || (uses_posts && check.defer_posts_pages)) {
+            continue;
+        } else if (has_posts && uses_posts) {
+            pass_add(&posts_pages_pass, entry);
+        } else {
+            pass_add(&pages_pass, entry);
+        }
+    }
 
-        char *site_subdir;
-        asprintf(&site_subdir, "%s/%s", site_dir, directory);
+    if (args->pipelined) {
+        generate_pipelined(args,
+                           &posts_pass,
+                           &pages_pass,
+                           &posts_pages_pass,
+                           layouts,
+                           num_layouts);
+    } else {
+        generate_scheduled(args,
+                           &posts_pass,
+                           &pages_pass,
+                           &posts_pages_pass);
+    }
 
-        struct generate_arguments args_r; /* Recursive call args */
-        args_r = *args;
-        args_r.curr_dir_name = subdir;
-        args_r.site_dir = site_subdir;
-        generate(&args_r);
+    /* The workers have hashed the files that the check left for them to */
+    for (i = 0; i < num_checked; i++) {
+        struct checked_entry *checked = &(checked_entries[i]);
+        if (checked->manifest_index != -1) {
+            manifest.entries[checked->manifest_index].hash
+                = checked->entry->hash;
+        }
+        if (checked->entry->source.data != NULL) {
+            unmap_file(&(checked->entry->source));
+        }
+        free(checked->out_file_name);
+        free(checked->layout_name);
+    }
+    free(checked_entries);
 
-        free(site_subdir);
-        free(subdir);
+    /* Record the build for the next one, or for the merge */
+    if (sharded) {
+        asprintf(&shard_manifest_file_name, "%s/%s%d-of-%d",
+                 args->site_dir, MANIFEST_SHARD_PREFIX,
+                 args->shard + 1, args->num_shards);
+        manifest_write(&manifest, shard_manifest_file_name);
+        free(shard_manifest_file_name);
+    } else {
+        remove_stale_outputs(&old_manifest,
+                             &manifest,
+                             args->site_dir,
+                             args->changes);
+        manifest_write(&manifest, manifest_file_name);
     }
-    
+
     /* Final Cleanup */
-    layouts_destroy(layouts, num_layouts);
-    for (i = 0; i < num_files; i++) {
-        free(file_names[i]);
+    pthread_mutex_destroy(&(check.mutex));
+    args->dirs = NULL;
+    dir_cache_destroy(&dirs);
+    manifest_destroy(&manifest);
+    manifest_destroy(&old_manifest);
+    free(manifest_file_name);
+    pass_destroy(&posts_pages_pass);
+    pass_destroy(&pages_pass);
+    pass_destroy(&posts_pass);
+    if (args->posts_inventory == NULL) {
+        inventory_destroy(pages_inventory);
+        inventory_destroy(posts_inventory);
     }
-    free(file_names);
-    free(directories);
+}
+
+static void
+manifest_add_entry(struct manifest *manifest, struct manifest_entry *entry)
+{
+    manifest_add(manifest,
+                 entry->in_path,
+                 entry->out_path,
+                 entry->size,
+                 entry->mtime,
+                 entry->hash,
+                 entry->deps,
+                 entry->layout,
+                 entry->flags);
+}
+
+/*
+ * Combine the manifests of the shards with that of the last full build into
+ * the site's manifest, removing the shards' manifests. The last build's
+ * entries stand for the files that no shard built, i.e. the pages that use
+ * the posts and the files that have since been removed, so that the build
+ * that follows only has to render the former and clean up after the latter.
+ * Returns the number of shard manifests merged.
+ */
+int
+generate_merge(const char *site_dir)
+{
+    struct manifest old_manifest;
+    struct manifest merged;
+    char *manifest_file_name;
+    bool has_old_manifest;
+    DIR *dir;
+    struct dirent *dirent;
+    size_t prefix_len = strlen(MANIFEST_SHARD_PREFIX);
+    int num_shards = 0;
+    int i;
+
+    asprintf(&manifest_file_name, "%s/%s", site_dir, MANIFEST_FILE_NAME);
+    manifest_init(&old_manifest);
+    has_old_manifest = manifest_read(&old_manifest, manifest_file_name);
+    manifest_init(&merged);
+    merged.posts = old_manifest.posts;
+    merged.build_time = has_old_manifest ? old_manifest.build_time : time(NULL);
+
+    dir = opendir(site_dir);
+    while (dir != NULL && (dirent = readdir(dir)) != NULL) {
+        if (strncmp(dirent->d_name, MANIFEST_SHARD_PREFIX, prefix_len) != 0) {
+            continue;
+        }
+        char *shard_file_name;
+        asprintf(&shard_file_name, "%s/%s", site_dir, dirent->d_name);
+        struct manifest shard_manifest;
+        manifest_init(&shard_manifest);
+        if (manifest_read(&shard_manifest, shard_file_name)) {
+            for (i = 0; i < shard_manifest.num_entries; i++) {
+                manifest_add_entry(&merged, &(shard_manifest.entries[i]));
+            }
+            merged.env = shard_manifest.env;
+
+            /* What changed during any shard's build counts as changed */
+            if (shard_manifest.build_time < merged.build_time) {
+                merged.build_time = shard_manifest.build_time;
+            }
+            num_shards++;
+        }
+        manifest_destroy(&shard_manifest);
+        unlink(shard_file_name);
+        free(shard_file_name);
+    }
+    if (dir != NULL) {
+        closedir(dir);
+    }
+
+    /* Find what the shards left out before adding any of it */
+    bool *carry = calloc(old_manifest.num_entries + 1, sizeof(bool));
+    for (i = 0; i < old_manifest.num_entries; i++) {
+        struct manifest_entry *entry = &(old_manifest.entries[i]);
+        carry[i] = manifest_find(&merged, entry->in_path) == NULL;
+    }
+    for (i = 0; i < old_manifest.num_entries; i++) {
+        if (carry[i]) {
+            manifest_add_entry(&merged, &(old_manifest.entries[i]));
+        }
+    }
+    if (num_shards > 0) {
+        manifest_write(&merged, manifest_file_name);
+    }
+
+    free(carry);
+    manifest_destroy(&merged);
+    manifest_destroy(&old_manifest);
+    free(manifest_file_name);
+    return num_shards;
 }
@@ -5,25 +5,58 @@
  */
 
 /*
- * Copyright (c) 2017 David Jackson
+ * Copyright (c) 2017-2026 David Jackson
  */
 
 #ifndef GENERATE_H
 #define GENERATE_H
 
+#include "thread_pool.h"
+#include "cache.h"
+#include "layout.h"
+#include "inventory.h"
+#include "changes.h"
+#include "processing.h"
+#include "dir_cache.h"
 #include <ctache/ctache.h>
 #include <pthread.h>
+#include <stdbool.h>
 
 struct generate_arguments {
     const char *curr_dir_name;
+    const char *posts_dir_name; /* NULL if the site has no posts */
     const char *site_dir;
-    int num_workers;
+    const char *publish_dir; /* Swapped with site_dir once built, or NULL */
+    struct thread_pool *pool;
     ctache_data_t *data;
     pthread_mutex_t *data_mutex;
-    void *(*process)(void*);
+    void *(*finish_posts)(void*); /* Run once every post has been processed */
+    void *finish_posts_arg;
+    bool pipelined; /* Use the staged pipeline instead of per-file workers */
+    int num_io_workers; /* Workers for each I/O stage of the pipeline */
+    struct cache *cache; /* The render cache, or NULL */
+    struct changes *changes; /* Where to record changed outputs, or NULL */
+    struct dir_cache *dirs; /* The output directories, set by generate() */
+    struct layout *layouts;
+    int num_layouts;
+    struct inventory *posts_inventory; /* Scanned by the caller, or NULL */
+    struct inventory *pages_inventory;
+    int shard; /* Which of the shards to build, counting from 0 */
+    int num_shards; /* 0 to build the whole site */
+    enum asset_mode assets; /* How binary files are published */
 };
 
+void
+generate_scan(const char *curr_dir_name,
+              const char *posts_dir_name,
+              const char *site_dir,
+              struct inventory *posts_inventory,
+              struct inventory *pages_inventory);
+
 void
 generate(struct generate_arguments *args);
 
+int
+generate_merge(const char *site_dir);
+
 #endif /* GENERATE_H */
@@ -0,0 +1,65 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Copyright (c) 2026 David Jackson
+ */
+
+#include "config.h"
+
+#include "hash.h"
+#include <stdio.h>
+#include <string.h>
+
+#define FNV_PRIME 0x100000001b3ULL
+#define HASH_BUFSIZE 65536
+
+uint64_t
+hash_bytes(uint64_t hash, const void *buf, size_t len)
+{
+    const unsigned char *bytes = (const unsigned char *) buf;
+    size_t i;
+    for (i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+/* Hash a string including its terminator so that "ab" + "c" != "a" + "bc" */
+uint64_t
+hash_string(uint64_t hash, const char *str)
+{
+    return hash_bytes(hash, str, strlen(str) + 1);
+}
+
+/* Returns false if the file could not be read */
+bool
+hash_file(const char *file_name, uint64_t *hash_ptr)
+{
+    FILE *fp = fopen(file_name, "rb");
+    if (fp == NULL) {
+        return false;
+    }
+
+    unsigned char *buf = malloc(HASH_BUFSIZE);
+    if (buf == NULL) {
+        fprintf(stderr, "ERROR: Could not malloc() for hash buffer\n");
+        abort();
+    }
+
+    uint64_t hash = HASH_INIT;
+    size_t bytes_read;
+    while ((bytes_read = fread(buf, 1, HASH_BUFSIZE, fp)) > 0) {
+        hash = hash_bytes(hash, buf, bytes_read);
+    }
+    bool ok = !ferror(fp);
+
+    free(buf);
+    fclose(fp);
+    *hash_ptr = hash;
+    return ok;
+}
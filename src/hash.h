@@ -0,0 +1,30 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Copyright (c) 2026 David Jackson
+ */
+
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+/* 64-bit FNV-1a, used to tell whether file contents have changed */
+#define HASH_INIT 0xcbf29ce484222325ULL
+
+uint64_t
+hash_bytes(uint64_t hash, const void *buf, size_t len);
+
+uint64_t
+hash_string(uint64_t hash, const char *str);
+
+bool
+hash_file(const char *file_name, uint64_t *hash_ptr);
+
+#endif /* HASH_H */
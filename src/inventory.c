@@ -0,0 +1,162 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Copyright (c) 2026 David Jackson
+ */
+
+#include "config.h"
+
+#include "inventory.h"
+#include "files.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_ENTRIES_BUFSIZE 64
+#define DEFAULT_SITE_DIRS_BUFSIZE 16
+
+void
+inventory_init(struct inventory *inventory)
+{
+    inventory->entries_bufsize = DEFAULT_ENTRIES_BUFSIZE;
+    inventory->num_entries = 0;
+    inventory->entries = malloc(sizeof(struct inventory_entry)
+                                * inventory->entries_bufsize);
+    if (inventory->entries == NULL) {
+        fprintf(stderr, "ERROR: Could not malloc() for inventory\n");
+        abort();
+    }
+    inventory->site_dirs_bufsize = DEFAULT_SITE_DIRS_BUFSIZE;
+    inventory->num_site_dirs = 0;
+    inventory->site_dirs = malloc(sizeof(char *)
+                                  * inventory->site_dirs_bufsize);
+    if (inventory->site_dirs == NULL) {
+        fprintf(stderr, "ERROR: Could not malloc() for inventory\n");
+        abort();
+    }
+}
+
+static void
+inventory_add_site_dir(struct inventory *inventory, const char *site_dir)
+{
+    if (inventory->num_site_dirs >= inventory->site_dirs_bufsize) {
+        inventory->site_dirs_bufsize *= 2;
+        inventory->site_dirs = realloc(inventory->site_dirs,
+                                       sizeof(char *)
+                                       * inventory->site_dirs_bufsize);
+        if (inventory->site_dirs == NULL) {
+            fprintf(stderr, "ERROR: Could not realloc() for inventory\n");
+            abort();
+        }
+    }
+    inventory->site_dirs[inventory->num_site_dirs++] = strdup(site_dir);
+}
+
+static void
+inventory_add(struct inventory *inventory,
+              char *in_path,
+              off_t size,
+              time_t mtime,
+              const char *site_dir)
+{
+    if (inventory->num_entries >= inventory->entries_bufsize) {
+        inventory->entries_bufsize *= 2;
+        size_t bufsize = sizeof(struct inventory_entry)
+            * inventory->entries_bufsize;
+        inventory->entries = realloc(inventory->entries, bufsize);
+        if (inventory->entries == NULL) {
+            fprintf(stderr, "ERROR: Could not realloc() for inventory\n");
+            abort();
+        }
+    }
+    struct inventory_entry *entry = &(inventory->entries[inventory->num_entries]);
+    entry->in_path = in_path;
+    entry->site_dir = strdup(site_dir);
+    entry->size = size;
+    entry->mtime = mtime;
+    entry->hash = 0;
+    entry->source_changed = false;
+    entry->up_to_date = false;
+    entry->cache_key.hash = 0;
+    entry->source.data = NULL;
+    entry->source.len = 0;
+    entry->source.is_mapped = false;
+    inventory->num_entries++;
+}
+
+/*
+ * Walk the tree rooted at dir_name, adding every file to the inventory along
+ * with the matching directory under site_dir. The directories are not made
+ * here, but once per build, by the build's directory cache.
+ */
+void
+inventory_scan(struct inventory *inventory,
+               const char *dir_name,
+               const char *site_dir)
+{
+    char **file_names;
+    off_t *file_sizes;
+    time_t *file_mtimes;
+    int num_files;
+    char **directories;
+    int num_directories;
+    int i;
+
+    get_file_list(dir_name,
+                  &file_names,
+                  &file_sizes,
+                  &file_mtimes,
+                  &num_files,
+                  &directories,
+                  &num_directories);
+
+    inventory_add_site_dir(inventory, site_dir);
+
+    for (i = 0; i < num_files; i++) {
+        inventory_add(inventory,
+                      file_names[i],
+                      file_sizes[i],
+                      file_mtimes[i],
+                      site_dir);
+    }
+
+    for (i = 0; i < num_directories; i++) {
+        char *directory = directories[i];
+
+        char *subdir;
+        asprintf(&subdir, "%s/%s", dir_name, directory);
+
+        char *site_subdir;
+        asprintf(&site_subdir, "%s/%s", site_dir, directory);
+
+        inventory_scan(inventory, subdir, site_subdir);
+
+        free(site_subdir);
+        free(subdir);
+        free(directory);
+    }
+
+    free(file_names);
+    free(file_sizes);
+    free(file_mtimes);
+    free(directories);
+}
+
+void
+inventory_destroy(struct inventory *inventory)
+{
+    int i;
+    for (i = 0; i < inventory->num_entries; i++) {
+        free(inventory->entries[i].in_path);
+        free(inventory->entries[i].site_dir);
+    }
+    free(inventory->entries);
+    for (i = 0; i < inventory->num_site_dirs; i++) {
+        free(inventory->site_dirs[i]);
+    }
+    free(inventory->site_dirs);
+}
@@ -0,0 +1,58 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Copyright (c) 2026 David Jackson
+ */
+
+#ifndef INVENTORY_H
+#define INVENTORY_H
+
+#include "files.h"
+#include "cache.h"
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+/* A single source file and the site directory its output is written into */
+struct inventory_entry {
+    char *in_path;
+    char *site_dir;
+    off_t size;
+    time_t mtime;
+    uint64_t hash; /* Hash of the contents, filled in by incremental builds */
+    bool source_changed; /* Its contents differ from those at the last build */
+    bool up_to_date; /* The output from a previous build can be kept */
+    struct cache_key cache_key; /* Of its output in the render cache */
+    struct mapped_file source; /* Its contents if kept from checking it */
+};
+
+/*
+ * A flat list of every source file in a tree, built before any processing,
+ * along with every site directory the tree maps to, parents first
+ */
+struct inventory {
+    struct inventory_entry *entries;
+    int num_entries;
+    int entries_bufsize;
+    char **site_dirs;
+    int num_site_dirs;
+    int site_dirs_bufsize;
+};
+
+void
+inventory_init(struct inventory *inventory);
+
+void
+inventory_scan(struct inventory *inventory,
+               const char *dir_name,
+               const char *site_dir);
+
+void
+inventory_destroy(struct inventory *inventory);
+
+#endif /* INVENTORY_H */
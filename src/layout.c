@@ -10,8 +10,11 @@
 
 #include "config.h"
 
+#include "common.h"
 #include "layout.h"
 #include "cytogen_header.h"
+#include "string_util.h"
+#include "hash.h"
 #include <ctache/ctache.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -103,7 +106,24 @@ read_layout_from_file(const char *file_name, struct layout *layout)
     size_t size = statbuf.st_size;
     char *content = layout_content_read(fd, size);
 
-    struct layout l = { layout_name, content, size };
+    /* Record the layout this one extends, if any, as its edge in the graph */
+    char *parent = NULL;
+    ctache_data_t *header_data = ctache_data_create_hash();
+    if (cytogen_header_read_from_string(content, header_data, NULL) > 0
+        && ctache_data_hash_table_has_key(header_data, LAYOUT)) {
+        ctache_data_t *str_data = ctache_data_hash_table_get(header_data,
+                                                             LAYOUT);
+        parent = string_trim(ctache_data_string_buffer(str_data), NULL);
+    }
+    ctache_data_destroy(header_data);
+
+    struct layout l = {
+        layout_name,
+        content,
+        size,
+        parent,
+        hash_bytes(HASH_INIT, content, size)
+    };
     *layout = l;
 
     close(fd);
@@ -146,7 +166,7 @@ struct layout
         struct layout layout = layouts[i];
         char *content = layout.content;
         ctache_data_t *header_data = ctache_data_create_hash();
-        int header_len = cytogen_header_read_from_string(content, header_data);
+        int header_len = cytogen_header_read_from_string(content, header_data, NULL);
         int repetitions = 0;
         while (header_len > 0) {
             /*
@@ -202,7 +222,7 @@ struct layout
             content = out;
             ctache_data_destroy(header_data);
             header_data = ctache_data_create_hash();
-            header_len = cytogen_header_read_from_string(content, header_data);
+            header_len = cytogen_header_read_from_string(content, header_data, NULL);
 
             repetitions++;
         }
@@ -222,22 +242,52 @@ layouts_destroy(struct layout *layouts, int num_layouts)
     for (i = 0; i < num_layouts; i++) {
         layout = layouts[i];
         free(layout.name);
+        free(layout.parent);
         layout_content_destroy(layout);
     }
+    free(layouts);
 }
 
-char
-*get_layout_content(struct layout *layouts, int num_layouts, const char *name)
+struct layout
+*layout_find(struct layout *layouts, int num_layouts, const char *name)
 {
-    char *layout_content = NULL;
     int i;
-    struct layout layout;
     for (i = 0; i < num_layouts; i++) {
-        layout = layouts[i];
-        if (strcmp(layout.name, name) == 0) {
-            layout_content = layout.content;
+        if (strcmp(layouts[i].name, name) == 0) {
+            return &(layouts[i]);
+        }
+    }
+    return NULL;
+}
+
+char
+*get_layout_content(struct layout *layouts, int num_layouts, const char *name)
+{
+    struct layout *layout = layout_find(layouts, num_layouts, name);
+    return layout != NULL ? layout->content : NULL;
+}
+
+/*
+ * Hash of the files of the named layout and of every layout it extends, i.e.
+ * of all the layouts that a file using it is rendered with. A NULL name, for a
+ * file with no layout, has a hash too. The walk up the graph is limited to
+ * num_layouts steps so that a cycle cannot make it loop forever.
+ */
+uint64_t
+layout_dependency_hash(struct layout *layouts,
+                       int num_layouts,
+                       const char *name)
+{
+    uint64_t hash = HASH_INIT;
+    int steps;
+    for (steps = 0; name != NULL && steps <= num_layouts; steps++) {
+        hash = hash_string(hash, name);
+        struct layout *layout = layout_find(layouts, num_layouts, name);
+        if (layout == NULL) {
             break;
         }
+        hash = hash_bytes(hash, &(layout->hash), sizeof(layout->hash));
+        name = layout->parent;
     }
-    return layout_content;
+    return hash;
 }
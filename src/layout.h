@@ -12,11 +12,18 @@
 #define LAYOUT_H
 
 #include <stdlib.h>
+#include <stdint.h>
 
+/*
+ * Layouts form a graph: each may extend one other layout, named by the
+ * "layout" key of its header. The content has the whole chain rendered in.
+ */
 struct layout {
     char *name;
     char *content;
     size_t length;
+    char *parent; /* The layout this one extends, or NULL */
+    uint64_t hash; /* Hash of the layout's own file */
 };
 
 struct layout
@@ -25,7 +32,15 @@ struct layout
 void
 layouts_destroy(struct layout *layouts, int num_layouts);
 
+struct layout
+*layout_find(struct layout *layouts, int num_layouts, const char *name);
+
 char
 *get_layout_content(struct layout *layouts, int num_layouts, const char *name);
 
+uint64_t
+layout_dependency_hash(struct layout *layouts,
+                       int num_layouts,
+                       const char *name);
+
 #endif /* LAYOUT_H */
@@ -5,7 +5,7 @@
  */
 
 /*
- * Copyright (c) 2016-2025 David Jackson
+ * Copyright (c) 2016-2026 David Jackson
  */
 
 #include "config.h"
@@ -20,6 +20,13 @@
 #include "initialize.h"
 #include "generate.h"
 #include "http.h"
+#include "thread_pool.h"
+#include "workers.h"
+#include "cache.h"
+#include "layout.h"
+#include "watch.h"
+#include "build_daemon.h"
+#include "changes.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/types.h>
@@ -28,42 +35,63 @@
 #include <pthread.h>
 #include <ctache/ctache.h>
 #include <ftw.h>
-#include <libgen.h>
 #include <dirent.h>
 #include <errno.h>
+#include <limits.h>
 #include <time.h>
 #include <ctype.h>
+#include <getopt.h>
+#include <signal.h>
+#include <sys/wait.h>
 
 #define USAGE "Usage: cyto [FLAGS] [COMMAND]"
 
-#define DEFAULT_NUM_WORKERS 4
+#define AUTO_NUM_WORKERS "auto"
 #define SITE_DIR "_site"
+#define STAGING_DIR "_site.staging"
 #define POSTS_DIR "_posts"
-#define SITE_POSTS_DIR "_site/posts"
-#define MAXFDS 100
 #define HTTP_PORT 8000
 #define DATE_BUFSIZE 11
-
-static int
-rename_posts();
-
-static int
-_rename_posts(const char *path,
-              const struct stat *stat_ptr,
-              int flag,
-              struct FTW *ftw);
+#define SHARD_OPTION 256
+#define STAGED_OPTION 257
+#define ASSETS_OPTION 258
 
 static void
-cmd_clean();
+cmd_clean(const char *cache_dir);
 
 static void
 print_help();
 
 static void
-cmd_generate(struct cyto_config *config,
-             const char *curr_dir_name,
+cmd_generate(const char *curr_dir_name,
              const char *site_dir,
-             int num_workers);
+             const char *publish_dir,
+             int num_workers,
+             int num_io_workers,
+             bool pipelined,
+             const char *cache_dir,
+             bool watching,
+             int shard,
+             int num_shards,
+             enum asset_mode assets);
+
+static void
+cmd_daemon(const char *curr_dir_name,
+           const char *site_dir,
+           const char *publish_dir,
+           int num_workers,
+           int num_io_workers,
+           bool pipelined,
+           const char *cache_dir,
+           enum asset_mode assets,
+           int num_workers_given);
+
+static char
+*daemon_request(bool staged,
+                enum asset_mode assets,
+                bool pipelined,
+                int num_workers_given,
+                const char *cache_dir);
 
 static void
 cmd_post(const char *post_name);
@@ -72,13 +100,39 @@ int
 main(int argc, char *argv[])
 {
     int num_workers;
+    int num_workers_given;
+    int num_io_workers;
+    bool pipelined;
+    char *cache_dir;
+    bool watching;
+    int shard;
+    int num_shards;
+    bool staged;
+    enum asset_mode assets;
+    const char *site_dir;
+    const char *publish_dir;
     char **args;
     int opt;
     extern char *optarg;
     extern int optind;
 
     num_workers = 0;
-    while ((opt = getopt(argc, argv, "hVj:")) != -1) {
+    pipelined = false;
+    cache_dir = NULL;
+    watching = false;
+    shard = 0;
+    num_shards = 0;
+    staged = false;
+    assets = ASSETS_COPY;
+    struct option long_options[] = {
+        { "watch", no_argument, NULL, 'w' },
+        { "shard", required_argument, NULL, SHARD_OPTION },
+        { "staged", no_argument, NULL, STAGED_OPTION },
+        { "assets", required_argument, NULL, ASSETS_OPTION },
+        { NULL, 0, NULL, 0 }
+    };
+    while ((opt = getopt_long(argc, argv, "hVj:pC:w", long_options, NULL))
+           != -1) {
         switch (opt) {
         case 'h':
             print_help();
@@ -89,7 +143,54 @@ main(int argc, char *argv[])
             exit(EXIT_SUCCESS);
             break;
         case 'j':
-            num_workers = atoi(optarg);
+            if (strcmp(optarg, AUTO_NUM_WORKERS) == 0) {
+                num_workers = 0;
+            } else {
+                char *end;
+                errno = 0;
+                long value = strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || errno != 0
+                    || value < 1 || value > INT_MAX) {
+                    fprintf(stderr, "Invalid number of workers: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                num_workers = (int) value;
+            }
+            break;
+        case 'p':
+            pipelined = true;
+            break;
+        case 'C':
+            free(cache_dir);
+            cache_dir = strdup(optarg);
+            break;
+        case 'w':
+            watching = true;
+            break;
+        case SHARD_OPTION: {
+            char extra;
+            if (sscanf(optarg, "%d/%d%c", &shard, &num_shards, &extra) != 2
+                || num_shards < 1 || shard < 1 || shard > num_shards) {
+                fprintf(stderr, "Invalid shard: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            shard--;
+            break;
+        }
+        case STAGED_OPTION:
+            staged = true;
+            break;
+        case ASSETS_OPTION:
+            if (strcmp(optarg, "copy") == 0) {
+                assets = ASSETS_COPY;
+            } else if (strcmp(optarg, "hardlink") == 0) {
+                assets = ASSETS_HARDLINK;
+            } else if (strcmp(optarg, "symlink") == 0) {
+                assets = ASSETS_SYMLINK;
+            } else {
+                fprintf(stderr, "Invalid assets mode: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
             break;
         default:
             exit(EXIT_FAILURE);
@@ -100,27 +201,50 @@ main(int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
     args = argv + optind;
+    if (watching && num_shards > 0) {
+        fprintf(stderr, "ERROR: A sharded build cannot be watched\n");
+        exit(EXIT_FAILURE);
+    }
 
+    /* Size the workers from the CPUs available unless told otherwise */
+    num_workers_given = num_workers;
+    num_io_workers = workers_io_bound();
     if (num_workers < 1) {
-        num_workers = DEFAULT_NUM_WORKERS;
+        num_workers = workers_cpu_bound();
     }
-
-    struct cyto_config config;
-    bool has_config = false;
-    struct stat statbuf;
-    int stat_retval = stat(CONFIG_FILE_NAME, &statbuf);
-    has_config = stat_retval == 0;
-    if (has_config) {
-        cyto_config_read(CONFIG_FILE_NAME, &config);
+    if (cache_dir == NULL) {
+        cache_dir = cache_default_dir();
     }
 
+    /* A staged build is built beside the site and swapped in when done */
+    site_dir = staged ? STAGING_DIR : SITE_DIR;
+    publish_dir = staged ? SITE_DIR : NULL;
+
     char *cmd = args[0];
     if (string_matches_any(cmd, 3, "g", "gen", "generate")) {
-        if (has_config) {
-            cmd_generate(&config, ".", SITE_DIR, num_workers);
-        } else {
-            cmd_generate(NULL, ".", SITE_DIR, num_workers);
+        /* Leave the build to the daemon if there is one with these options */
+        if (!watching && num_shards == 0) {
+            char *request = daemon_request(staged, assets, pipelined,
+                                           num_workers_given, cache_dir);
+            int status = build_daemon_request(BUILD_DAEMON_SOCKET, request);
+            free(request);
+            if (status >= 0) {
+                exit(status);
+            }
         }
+        cmd_generate(".", site_dir, publish_dir, num_workers, num_io_workers,
+                     pipelined, cache_dir, watching, shard, num_shards,
+                     assets);
+    } else if (string_matches_any(cmd, 2, "m", "merge")) {
+        if (generate_merge(site_dir) == 0) {
+            fprintf(stderr, "ERROR: No shards to merge\n");
+            exit(EXIT_FAILURE);
+        }
+        cmd_generate(".", site_dir, publish_dir, num_workers, num_io_workers,
+                     pipelined, cache_dir, false, 0, 0, assets);
+    } else if (string_matches_any(cmd, 2, "d", "daemon")) {
+        cmd_daemon(".", site_dir, publish_dir, num_workers, num_io_workers,
+                   pipelined, cache_dir, assets, num_workers_given);
     } else if (string_matches_any(cmd, 2, "i", "init")) {
         char *proj_name;
         if (argc == 3) {
@@ -130,7 +254,7 @@ main(int argc, char *argv[])
         }
         cmd_initialize(proj_name);
     } else if (string_matches_any(cmd, 2, "c", "clean")) { 
-        cmd_clean();
+        cmd_clean(cache_dir);
     } else if (string_matches_any(cmd, 2, "s", "serve")) {
         http_server(HTTP_PORT);
     } else if (string_matches_any(cmd, 2, "p", "post")) {
@@ -147,67 +271,57 @@ main(int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
 
-    if (has_config) {
-        cyto_config_destroy(&config);
-    }
+    free(cache_dir);
 
     return 0;
 }
 
 static int
-rename_posts()
+posts_array_compar(const void *p1, const void *p2)
 {
-    return nftw(SITE_POSTS_DIR, _rename_posts, MAXFDS, 0);
+    ctache_data_t *d1 = (ctache_data_t *)p1;
+    ctache_data_t *d2 = (ctache_data_t *)p2;
+    const ctache_data_t *str1 = ctache_data_hash_table_get(d1, "url");
+    const ctache_data_t *str2 = ctache_data_hash_table_get(d2, "url");
+    return ctache_data_strcmp(str1, str2) * -1;
 }
 
-/* NOTE: This function is not thread-safe */
-static int
-_rename_posts(const char *path,
-              const struct stat *stat_ptr,
-              int flag,
-              struct FTW *ftw)
+/* Put the finished posts in order once they have all been processed */
+static void
+*finish_posts(void *posts_array_ptr)
 {
-    char *in_path;
-    char *dir;
-    char index_html[] = "index.html";
-    char *out_path;
-
-    if (flag == FTW_F) {
-        in_path = strdup(path);
-        dir = dirname(in_path); /* dirname() is not thread-safe */
-        if (asprintf(&out_path, "%s/%s", dir, index_html) == -1) {
-            fprintf(stderr, "Could not asprintf() index HTML file name\n");
-            abort();
-        }
-        rename(path, out_path);
-        free(out_path);
-        free(in_path);
-    }
+    ctache_data_t *posts_array = (ctache_data_t *) posts_array_ptr;
+    ctache_array_sort(posts_array, posts_array_compar);
+    return NULL;
+}
 
-    return 0;
+static bool
+read_config(struct cyto_config *config)
+{
+    struct stat statbuf;
+    if (stat(CONFIG_FILE_NAME, &statbuf) != 0) {
+        return false;
+    }
+    cyto_config_read(CONFIG_FILE_NAME, config);
+    return true;
 }
 
-static int
-posts_array_compar(const void *p1, const void *p2)
+static bool
+site_has_posts(void)
 {
-    ctache_data_t *d1 = (ctache_data_t *)p1;
-    ctache_data_t *d2 = (ctache_data_t *)p2;
-    const ctache_data_t *str1 = ctache_data_hash_table_get(d1, "url");
-    const ctache_data_t *str2 = ctache_data_hash_table_get(d2, "url");
-    return ctache_data_strcmp(str1, str2) * -1;
+    struct stat statbuf;
+    return stat(POSTS_DIR, &statbuf) == 0 && statbuf.st_mode & S_IFDIR;
 }
 
+/* Build the site once, setting up the data afresh */
 static void
-cmd_generate(struct cyto_config *config,
-             const char *curr_dir_name,
-             const char *site_dir,
-             int num_workers)
+build_site(struct cyto_config *config, struct generate_arguments *args)
 {
     ctache_data_t *data;
     pthread_mutex_t data_mutex;
-    struct stat statbuf;
     bool has_posts;
-    struct generate_arguments args;
+    struct changes changes;
+    char *changes_file_name;
 
     /* Set up the data */
     data = ctache_data_create_hash();
@@ -222,43 +336,405 @@ cmd_generate(struct cyto_config *config,
     pthread_mutex_init(&data_mutex, NULL);
 
     /* Set up the posts data */
-    has_posts = stat(POSTS_DIR, &statbuf) == 0 && statbuf.st_mode & S_IFDIR;
+    has_posts = site_has_posts();
     ctache_data_t *posts_array = NULL;
     if (has_posts) {
         posts_array = ctache_data_create_array(0);
         ctache_data_hash_table_set(data, "posts", posts_array);
     }
 
+    /*
+     * A staged build starts from the site that is published, not the older
+     * one that was swapped out for it, so that what it reports as changed is
+     * relative to what is being served. The shards of a sharded build may
+     * run at once, so they build over the staging directory as it is, and so
+     * does the merge that finishes them.
+     */
+    if (args->publish_dir != NULL && args->num_shards == 0
+        && !changes_have_shards(args->site_dir)) {
+        sync_directory(args->publish_dir, args->site_dir);
+    }
+
+    /* Report what this build changes, along with any unmerged shards */
+    changes_init(&changes, args->site_dir);
+    if (args->num_shards == 0) {
+        changes_read_shards(&changes, args->site_dir);
+    }
+
+    /* Perform the generation */
+    args->changes = &changes;
+    args->posts_dir_name = has_posts ? POSTS_DIR : NULL;
+    args->data = data;
+    args->data_mutex = &data_mutex;
+    args->finish_posts_arg = posts_array;
+    generate(args);
+
+    /* Create the Atom/RSS feed file, which a shard leaves to the merge */
+    if (config != NULL && has_posts && args->num_shards == 0) {
+        generate_feed(config, posts_array, args->site_dir, &changes);
+    }
+    if (args->num_shards > 0) {
+        asprintf(&changes_file_name, "%s/%s%d-of-%d",
+                 args->site_dir, CHANGES_SHARD_PREFIX,
+                 args->shard + 1, args->num_shards);
+    } else {
+        asprintf(&changes_file_name, "%s/%s",
+                 args->site_dir, CHANGES_FILE_NAME);
+    }
+    changes_write(&changes, changes_file_name);
+    free(changes_file_name);
+
+    /* Publish a staged build, keeping the old site to build the next into */
+    if (args->publish_dir != NULL && args->num_shards == 0
+        && !swap_directories(args->site_dir, args->publish_dir)) {
+        fprintf(stderr, "ERROR: Could not swap %s into place as %s\n",
+                args->site_dir, args->publish_dir);
+    }
+
+    /* Clean up */
+    changes_destroy(&changes);
+    pthread_mutex_destroy(&data_mutex);
+    ctache_data_destroy(data);
+}
+
+static long
+elapsed_ms(struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000
+        + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+/*
+ * Keep the config and layouts in memory and rebuild whenever the sources
+ * change, reloading only the config or layouts if those are what changed.
+ * The build manifest means only the affected outputs are regenerated.
+ */
+static void
+watch_site(struct watch *watch,
+           struct cyto_config *config,
+           bool *has_config,
+           struct generate_arguments *args)
+{
+    int changes;
+    printf("Watching for changes...\n");
+    fflush(stdout);
+    while ((changes = watch_wait(watch)) >= 0) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (changes & WATCH_CONFIG) {
+            if (*has_config) {
+                cyto_config_destroy(config);
+            }
+            *has_config = read_config(config);
+        }
+        if (changes & WATCH_LAYOUTS) {
+            layouts_destroy(args->layouts, args->num_layouts);
+            args->layouts = get_layouts(&(args->num_layouts));
+        }
+        if (changes != 0) {
+            build_site(*has_config ? config : NULL, args);
+            printf("Regenerated the site in %ld ms\n", elapsed_ms(&start));
+            fflush(stdout);
+        }
+    }
+}
+
+static void
+cmd_generate(const char *curr_dir_name,
+             const char *site_dir,
+             const char *publish_dir,
+             int num_workers,
+             int num_io_workers,
+             bool pipelined,
+             const char *cache_dir,
+             bool watching,
+             int shard,
+             int num_shards,
+             enum asset_mode assets)
+{
+    struct cyto_config config;
+    bool has_config;
+    struct generate_arguments args;
+    struct thread_pool *pool;
+    struct cache cache;
+    bool has_cache;
+    struct watch watch;
+
+    /* Watch first so that nothing changed during the first build is missed */
+    if (watching && !watch_init(&watch, curr_dir_name)) {
+        exit(EXIT_FAILURE);
+    }
+
+    has_config = read_config(&config);
+
+    /* Rendered outputs are shared by every build on the machine */
+    has_cache = cache_init(&cache, cache_dir);
+
+    /* One pool of workers is shared by every pass of the build */
+    pool = thread_pool_create(num_workers);
+
     /* Set up the generation arguments */
     args.curr_dir_name = curr_dir_name;
     args.site_dir = site_dir;
-    args.num_workers = num_workers;
-    args.data = data;
-    args.data_mutex = &data_mutex;
+    args.publish_dir = publish_dir;
+    args.pool = pool;
+    args.finish_posts = finish_posts;
+    args.num_io_workers = num_io_workers;
+    args.pipelined = pipelined;
+    args.cache = has_cache ? &cache : NULL;
+    args.layouts = get_layouts(&(args.num_layouts));
+    args.posts_inventory = NULL;
+    args.pages_inventory = NULL;
+    args.shard = shard;
+    args.num_shards = num_shards;
+    args.assets = assets;
+
+    build_site(has_config ? &config : NULL, &args);
+    if (watching) {
+        watch_site(&watch, &config, &has_config, &args);
+        watch_destroy(&watch);
+    }
 
-    /* Perform the generation */
-    if (has_posts) {
-        args.curr_dir_name = POSTS_DIR;
-        args.process = process_post_files;
+    /* Clean up */
+    layouts_destroy(args.layouts, args.num_layouts);
+    thread_pool_destroy(pool);
+    if (has_cache) {
+        cache_destroy(&cache);
+    }
+    if (has_config) {
+        cyto_config_destroy(&config);
+    }
+}
+
+static volatile sig_atomic_t daemon_stopping = 0;
+
+static void
+daemon_stop(int sig)
+{
+    (void) sig;
+    daemon_stopping = 1;
+}
+
+/*
+ * The request for a build with the given options, which a daemon only serves
+ * if it builds with the same ones. A number of workers of 0 is left to the
+ * daemon.
+ */
+static char
+*daemon_request(bool staged,
+                enum asset_mode assets,
+                bool pipelined,
+                int num_workers_given,
+                const char *cache_dir)
+{
+    char *request;
+    if (asprintf(&request, "%s staged=%d assets=%d pipelined=%d jobs=%d "
+                 "cache=%s",
+                 BUILD_DAEMON_GENERATE,
+                 staged,
+                 (int) assets,
+                 pipelined,
+                 num_workers_given,
+                 cache_dir != NULL ? cache_dir : "") == -1) {
+        fprintf(stderr, "ERROR: Could not asprintf() daemon request\n");
+        abort();
+    }
+    return request;
+}
 
-        generate(&args);
-        rename_posts();
+/*
+ * Build the site for a client in a child process, so that its output goes to
+ * the client and a failed build cannot take the daemon down with it. Returns
+ * the exit status of the build.
+ */
+static int
+daemon_build(int client_fd,
+             int listen_fd,
+             struct cyto_config *config,
+             const char *cache_dir,
+             int num_workers,
+             struct generate_arguments *args)
+{
+    int status;
+
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        return EXIT_FAILURE;
+    }
+    if (pid == 0) {
+        struct cache cache;
+        bool has_cache;
+
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        close(listen_fd);
+        dup2(client_fd, STDOUT_FILENO);
+        dup2(client_fd, STDERR_FILENO);
+        close(client_fd);
+
+        has_cache = cache_init(&cache, cache_dir);
+        args->cache = has_cache ? &cache : NULL;
+        args->pool = thread_pool_create(num_workers);
+        build_site(config, args);
+        fflush(stdout);
+        _exit(EXIT_SUCCESS);
+    }
 
-        args.curr_dir_name = curr_dir_name;
-	ctache_array_sort(posts_array, posts_array_compar);
+    while (waitpid(pid, &status, 0) == -1) {
+        if (errno != EINTR) {
+            perror("waitpid");
+            return EXIT_FAILURE;
+        }
+    }
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
     }
+    return EXIT_FAILURE;
+}
 
-    args.process = process_files;
-    generate(&args);
+/*
+ * Serve builds over a UNIX socket, keeping the config, layouts and source
+ * inventories in memory between them. Only what the watch reports as changed
+ * is reloaded. The site itself is not watched, so every request is built,
+ * checked against the manifest: with nothing changed, that only replaces any
+ * outputs that have gone missing.
+ */
+static void
+cmd_daemon(const char *curr_dir_name,
+           const char *site_dir,
+           const char *publish_dir,
+           int num_workers,
+           int num_io_workers,
+           bool pipelined,
+           const char *cache_dir,
+           enum asset_mode assets,
+           int num_workers_given)
+{
+    struct cyto_config config;
+    bool has_config;
+    struct generate_arguments args;
+    struct inventory posts_inventory;
+    struct inventory pages_inventory;
+    struct watch watch;
+    bool watching;
+    struct sigaction action;
+    int listen_fd;
+    int client_fd;
+    char request[BUILD_DAEMON_REQUEST_MAX];
+    char *served_request;
+    char *served_auto_request;
+
+    listen_fd = build_daemon_listen(BUILD_DAEMON_SOCKET);
+    if (listen_fd == -1) {
+        exit(EXIT_FAILURE);
+    }
+    memset(&action, 0, sizeof(struct sigaction));
+    action.sa_handler = daemon_stop; /* No SA_RESTART, to stop accept() */
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    /* Without a watch, everything is reloaded for every request */
+    watching = watch_init(&watch, curr_dir_name);
+    if (!watching) {
+        fprintf(stderr, "WARNING: Reloading the site for every build\n");
+    }
 
-    /* Create the Atom/RSS feed file */
-    if (config != NULL && has_posts) {
-        generate_feed(config, posts_array);
+    has_config = read_config(&config);
+    args.curr_dir_name = curr_dir_name;
+    args.site_dir = site_dir;
+    args.publish_dir = publish_dir;
+    args.finish_posts = finish_posts;
+    args.num_io_workers = num_io_workers;
+    args.pipelined = pipelined;
+    args.layouts = get_layouts(&(args.num_layouts));
+    args.posts_inventory = &posts_inventory;
+    args.pages_inventory = &pages_inventory;
+    args.shard = 0;
+    args.num_shards = 0;
+    args.assets = assets;
+    generate_scan(curr_dir_name, site_has_posts() ? POSTS_DIR : NULL,
+                  site_dir, &posts_inventory, &pages_inventory);
+
+    /* A client that leaves the number of workers to the daemon is served too */
+    served_request = daemon_request(publish_dir != NULL, assets, pipelined,
+                                    num_workers_given, cache_dir);
+    served_auto_request = daemon_request(publish_dir != NULL, assets,
+                                         pipelined, 0, cache_dir);
+
+    printf("Listening on %s\n", BUILD_DAEMON_SOCKET);
+    fflush(stdout);
+    while (!daemon_stopping
+           && (client_fd = build_daemon_accept(listen_fd,
+                                               request,
+                                               sizeof(request))) != -1) {
+        if (strcmp(request, served_request) != 0
+            && strcmp(request, served_auto_request) != 0) {
+            build_daemon_finish(client_fd, BUILD_DAEMON_DECLINED);
+            printf("Declined a build with other options\n");
+            fflush(stdout);
+            continue;
+        }
+
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        int changes = -1;
+        if (watching) {
+            changes = watch_poll(&watch);
+        }
+        if (changes < 0) {
+            changes = WATCH_SOURCES | WATCH_LAYOUTS | WATCH_CONFIG;
+        }
+        if (changes & WATCH_CONFIG) {
+            if (has_config) {
+                cyto_config_destroy(&config);
+            }
+            has_config = read_config(&config);
+        }
+        if (changes & WATCH_LAYOUTS) {
+            layouts_destroy(args.layouts, args.num_layouts);
+            args.layouts = get_layouts(&(args.num_layouts));
+        }
+        if (changes & WATCH_SOURCES) {
+            inventory_destroy(&posts_inventory);
+            inventory_destroy(&pages_inventory);
+            generate_scan(curr_dir_name, site_has_posts() ? POSTS_DIR : NULL,
+                          site_dir, &posts_inventory, &pages_inventory);
+        }
+
+        int status = daemon_build(client_fd, listen_fd,
+                                  has_config ? &config : NULL,
+                                  cache_dir, num_workers, &args);
+        build_daemon_finish(client_fd, status);
+        if (status == EXIT_SUCCESS) {
+            printf("Regenerated the site in %ld ms\n", elapsed_ms(&start));
+        } else {
+            printf("Build failed with status %d\n", status);
+        }
+        fflush(stdout);
     }
 
     /* Clean up */
-    pthread_mutex_destroy(&data_mutex);
-    ctache_data_destroy(data);
+    free(served_auto_request);
+    free(served_request);
+    close(listen_fd);
+    unlink(BUILD_DAEMON_SOCKET);
+    inventory_destroy(&pages_inventory);
+    inventory_destroy(&posts_inventory);
+    layouts_destroy(args.layouts, args.num_layouts);
+    if (watching) {
+        watch_destroy(&watch);
+    }
+    if (has_config) {
+        cyto_config_destroy(&config);
+    }
 }
 
 int
@@ -275,10 +751,13 @@ _clean(const char *path, const struct stat *stat, int flag, struct FTW *ftw_ptr)
     return 0;
 }
 
+/* Remove the site, and the render cache if one is given */
 static void
-cmd_clean()
+cmd_clean(const char *cache_dir)
 {
     nftw(SITE_DIR, _clean, 1000, FTW_DEPTH); 
+    nftw(STAGING_DIR, _clean, 1000, FTW_DEPTH);
+    cache_clean(cache_dir);
 }
 
 static void
@@ -288,12 +767,25 @@ print_help()
     printf("Flags:\n");
     printf("\t-h Print this help message\n");
     printf("\t-V Print the version number\n");
-    printf("\t-j [THREADS] Set number of worker threads (default is 4)\n");
+    printf("\t-j [THREADS] Set number of worker threads, "
+           "or \"auto\" (the default) to use one per available CPU\n");
+    printf("\t-p Process files in a pipeline of I/O and CPU stages\n");
+    printf("\t-C [DIR] Use a render cache in DIR, or \"none\" (the default) "
+           "to not use one\n");
+    printf("\t-w, --watch Keep regenerating the site as its sources change\n");
+    printf("\t--shard [I/N] Generate only the Ith of N shares of the site\n");
+    printf("\t--staged Generate the site beside %s and swap it into place\n",
+           SITE_DIR);
+    printf("\t--assets=[MODE] Publish binary files as a \"copy\" (the "
+           "default), \"hardlink\" or \"symlink\"\n");
     printf("Commands:\n");
-    printf("\tclean - Remove generated site files\n");
+    printf("\tclean - Remove generated site files, and any render cache "
+           "given\n");
+    printf("\tdaemon - Serve builds of the current directory to generate\n");
     printf("\tgenerate - Generate a site from the current directory\n");
     printf("\thelp - Print this help message\n");
     printf("\tinit [PROJECT_NAME] - Initialize a cytogen project\n");
+    printf("\tmerge - Finish generating a site from its shards\n");
     printf("\tpost [TITLE] - Create a post with the given title\n");
     printf("\tserve - Start an HTTP server in the current directory\n");
 }
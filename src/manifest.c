@@ -0,0 +1,248 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Copyright (c) 2026 David Jackson
+ */
+
+#include "config.h"
+
+#include "manifest.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+
+#define MANIFEST_VERSION 3
+#define NUM_FIELDS 8
+#define DEFAULT_ENTRIES_BUFSIZE 64
+#define LINE_BUFSIZE 8192
+
+/*
+ * The manifest is a text file: a version line, a line holding the environment
+ * hash, the posts hash and the build time, then one tab-separated line per
+ * source file, whose output path is relative to the site directory. An empty
+ * layout field means the file has no layout.
+ */
+
+void
+manifest_init(struct manifest *manifest)
+{
+    manifest->entries_bufsize = DEFAULT_ENTRIES_BUFSIZE;
+    manifest->num_entries = 0;
+    manifest->entries = malloc(sizeof(struct manifest_entry)
+                               * manifest->entries_bufsize);
+    if (manifest->entries == NULL) {
+        fprintf(stderr, "ERROR: Could not malloc() for manifest\n");
+        abort();
+    }
+    manifest->env = 0;
+    manifest->posts = 0;
+    manifest->build_time = 0;
+    manifest->sorted = true;
+}
+
+void
+manifest_add(struct manifest *manifest,
+             const char *in_path,
+             const char *out_path,
+             off_t size,
+             time_t mtime,
+             uint64_t hash,
+             uint64_t deps,
+             const char *layout,
+             int flags)
+{
+    if (manifest->num_entries >= manifest->entries_bufsize) {
+        manifest->entries_bufsize *= 2;
+        size_t bufsize = sizeof(struct manifest_entry)
+            * manifest->entries_bufsize;
+        manifest->entries = realloc(manifest->entries, bufsize);
+        if (manifest->entries == NULL) {
+            fprintf(stderr, "ERROR: Could not realloc() for manifest\n");
+            abort();
+        }
+    }
+    struct manifest_entry *entry;
+    entry = &(manifest->entries[manifest->num_entries]);
+    entry->in_path = strdup(in_path);
+    entry->out_path = strdup(out_path);
+    entry->size = size;
+    entry->mtime = mtime;
+    entry->hash = hash;
+    entry->deps = deps;
+    entry->layout = strdup(layout != NULL ? layout : "");
+    entry->flags = flags;
+    manifest->num_entries++;
+    manifest->sorted = false;
+}
+
+/* Parse one entry line, which is modified in place. Returns false if invalid */
+static bool
+manifest_parse_line(struct manifest *manifest, char *line)
+{
+    char *fields[NUM_FIELDS];
+    int num_fields = 0;
+    char *field = line;
+    while (num_fields < NUM_FIELDS) {
+        fields[num_fields] = field;
+        num_fields++;
+        char *tab = strchr(field, '\t');
+        if (tab == NULL) {
+            break;
+        }
+        *tab = '\0';
+        field = tab + 1;
+    }
+    if (num_fields != NUM_FIELDS) {
+        return false;
+    }
+    char *newline = strchr(fields[7], '\n');
+    if (newline == NULL) {
+        return false;
+    }
+    *newline = '\0';
+
+    manifest_add(manifest,
+                 fields[6],
+                 fields[7],
+                 (off_t) strtoll(fields[3], NULL, 10),
+                 (time_t) strtoll(fields[4], NULL, 10),
+                 strtoull(fields[0], NULL, 16),
+                 strtoull(fields[1], NULL, 16),
+                 fields[5],
+                 (int) strtol(fields[2], NULL, 16));
+    return true;
+}
+
+/*
+ * Load the manifest written by a previous build. Returns false, leaving the
+ * manifest empty, if there is none or it cannot be used.
+ */
+bool
+manifest_read(struct manifest *manifest, const char *file_name)
+{
+    FILE *fp = fopen(file_name, "r");
+    if (fp == NULL) {
+        return false;
+    }
+
+    char *line = malloc(LINE_BUFSIZE);
+    int version = 0;
+    long long build_time = 0;
+    bool ok = fscanf(fp, "cyto-manifest %d\n", &version) == 1
+        && version == MANIFEST_VERSION
+        && fscanf(fp, "%" SCNx64 " %" SCNx64 " %lld\n",
+                  &(manifest->env),
+                  &(manifest->posts),
+                  &build_time) == 3;
+    while (ok && fgets(line, LINE_BUFSIZE, fp) != NULL) {
+        ok = manifest_parse_line(manifest, line);
+    }
+    manifest->build_time = (time_t) build_time;
+
+    free(line);
+    fclose(fp);
+
+    if (!ok) {
+        manifest_destroy(manifest);
+        manifest_init(manifest);
+
+        /* One from another version of cyto just means a full build */
+        if (version == MANIFEST_VERSION) {
+            fprintf(stderr, "WARNING: Ignoring invalid %s\n", file_name);
+        }
+    }
+    return ok;
+}
+
+static int
+manifest_entry_compare(const void *entry_1, const void *entry_2)
+{
+    const struct manifest_entry *e1 = (const struct manifest_entry *) entry_1;
+    const struct manifest_entry *e2 = (const struct manifest_entry *) entry_2;
+    return strcmp(e1->in_path, e2->in_path);
+}
+
+/* Returns NULL if the manifest has no entry for in_path */
+struct manifest_entry
+*manifest_find(struct manifest *manifest, const char *in_path)
+{
+    if (!manifest->sorted) {
+        qsort(manifest->entries,
+              manifest->num_entries,
+              sizeof(struct manifest_entry),
+              manifest_entry_compare);
+        manifest->sorted = true;
+    }
+    struct manifest_entry key;
+    key.in_path = (char *) in_path;
+    return bsearch(&key,
+                   manifest->entries,
+                   manifest->num_entries,
+                   sizeof(struct manifest_entry),
+                   manifest_entry_compare);
+}
+
+/* Written to a temporary file first so that a crash never leaves half of one */
+void
+manifest_write(struct manifest *manifest, const char *file_name)
+{
+    char *tmp_file_name;
+    if (asprintf(&tmp_file_name, "%s.tmp", file_name) == -1) {
+        fprintf(stderr, "ERROR: Could not asprintf() manifest file name\n");
+        abort();
+    }
+    FILE *fp = fopen(tmp_file_name, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "ERROR: Could not open for writing: %s\n", tmp_file_name);
+        free(tmp_file_name);
+        return;
+    }
+
+    fprintf(fp, "cyto-manifest %d\n", MANIFEST_VERSION);
+    fprintf(fp, "%016" PRIx64 " %016" PRIx64 " %lld\n",
+            manifest->env,
+            manifest->posts,
+            (long long) manifest->build_time);
+    int i;
+    for (i = 0; i < manifest->num_entries; i++) {
+        struct manifest_entry *entry = &(manifest->entries[i]);
+        fprintf(fp,
+                "%016" PRIx64 "\t%016" PRIx64 "\t%x\t%lld\t%lld\t%s\t%s\t%s\n",
+                entry->hash,
+                entry->deps,
+                entry->flags,
+                (long long) entry->size,
+                (long long) entry->mtime,
+                entry->layout,
+                entry->in_path,
+                entry->out_path);
+    }
+
+    if (fclose(fp) == 0) {
+        rename(tmp_file_name, file_name);
+    } else {
+        fprintf(stderr, "ERROR: Could not write %s\n", tmp_file_name);
+        unlink(tmp_file_name);
+    }
+    free(tmp_file_name);
+}
+
+void
+manifest_destroy(struct manifest *manifest)
+{
+    int i;
+    for (i = 0; i < manifest->num_entries; i++) {
+        free(manifest->entries[i].in_path);
+        free(manifest->entries[i].out_path);
+        free(manifest->entries[i].layout);
+    }
+    free(manifest->entries);
+    manifest->entries = NULL;
+    manifest->num_entries = 0;
+}
@@ -0,0 +1,77 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Copyright (c) 2026 David Jackson
+ */
+
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <time.h>
+
+#define MANIFEST_FILE_NAME ".cyto-manifest"
+#define MANIFEST_SHARD_PREFIX ".cyto-manifest.shard-"
+
+/* Entry flags */
+#define MANIFEST_USES_POSTS 0x1
+
+/* What one source file looked like when its output was last written */
+struct manifest_entry {
+    char *in_path;
+    char *out_path; /* Relative to the site directory */
+    off_t size;
+    time_t mtime;
+    uint64_t hash; /* Hash of the source file's contents */
+    uint64_t deps; /* Hash of the config and layouts it was rendered with */
+    char *layout; /* The layout it uses, its edge in the layout graph */
+    int flags;
+};
+
+/*
+ * The record of a build, kept in the site directory so that the next build
+ * can skip every file whose inputs have not changed since.
+ */
+struct manifest {
+    struct manifest_entry *entries;
+    int num_entries;
+    int entries_bufsize;
+    uint64_t env; /* Hash of the config shared by every file */
+    uint64_t posts; /* Hash of the posts, for the pages that list them */
+    time_t build_time;
+    bool sorted;
+};
+
+void
+manifest_init(struct manifest *manifest);
+
+bool
+manifest_read(struct manifest *manifest, const char *file_name);
+
+void
+manifest_add(struct manifest *manifest,
+             const char *in_path,
+             const char *out_path,
+             off_t size,
+             time_t mtime,
+             uint64_t hash,
+             uint64_t deps,
+             const char *layout,
+             int flags);
+
+struct manifest_entry
+*manifest_find(struct manifest *manifest, const char *in_path);
+
+void
+manifest_write(struct manifest *manifest, const char *file_name);
+
+void
+manifest_destroy(struct manifest *manifest);
+
+#endif /* MANIFEST_H */
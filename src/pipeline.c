@@ -0,0 +1,453 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Copyright (c) 2026 David Jackson
+ */
+
+#include "config.h"
+
+#include "common.h"
+#include "pipeline.h"
+#include "processing.h"
+#include "render.h"
+#include "files.h"
+#include "cytogen_header.h"
+#include "work_queue.h"
+#include "hash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <ctache/ctache.h>
+
+#define QUEUE_CAPACITY 64
+#define NUM_STAGES 5
+
+/* A file on its way through the pipeline */
+struct document {
+    struct inventory_entry *entry;
+    bool is_post;
+    bool is_markdown;
+    char *out_file_name;
+    struct mapped_file source;
+    const char *body;
+    size_t body_len;
+    char *html;
+    char *output;
+    size_t output_len;
+    ctache_data_t *empty;
+    ctache_data_t *file_data;
+};
+
+/* A fixed-capacity queue that blocks producers when full */
+struct bounded_queue {
+    struct document *items[QUEUE_CAPACITY];
+    int head;
+    int count;
+    int num_producers;
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+};
+
+struct pipeline;
+
+struct pipeline_stage {
+    bool (*func)(struct pipeline *pipeline, struct document *doc);
+    int num_workers;
+    struct bounded_queue *in;
+    struct bounded_queue *out;
+    struct pipeline *pipeline;
+};
+
+struct pipeline {
+    struct pipeline_arguments *args;
+    ctache_data_t *posts_arr;
+    struct work_queue documents;
+    struct bounded_queue queues[NUM_STAGES - 1];
+    struct pipeline_stage stages[NUM_STAGES];
+};
+
+static void
+bounded_queue_init(struct bounded_queue *queue, int num_producers)
+{
+    queue->head = 0;
+    queue->count = 0;
+    queue->num_producers = num_producers;
+    pthread_mutex_init(&(queue->mutex), NULL);
+    pthread_cond_init(&(queue->not_empty), NULL);
+    pthread_cond_init(&(queue->not_full), NULL);
+}
+
+static void
+bounded_queue_push(struct bounded_queue *queue, struct document *doc)
+{
+    pthread_mutex_lock(&(queue->mutex));
+    while (queue->count == QUEUE_CAPACITY) {
+        pthread_cond_wait(&(queue->not_full), &(queue->mutex));
+    }
+    queue->items[(queue->head + queue->count) % QUEUE_CAPACITY] = doc;
+    queue->count++;
+    pthread_cond_signal(&(queue->not_empty));
+    pthread_mutex_unlock(&(queue->mutex));
+}
+
+/* Returns NULL once the queue is empty and all of its producers are done */
+static struct document
+*bounded_queue_pop(struct bounded_queue *queue)
+{
+    struct document *doc = NULL;
+    pthread_mutex_lock(&(queue->mutex));
+    while (queue->count == 0 && queue->num_producers > 0) {
+        pthread_cond_wait(&(queue->not_empty), &(queue->mutex));
+    }
+    if (queue->count > 0) {
+        doc = queue->items[queue->head];
+        queue->head = (queue->head + 1) % QUEUE_CAPACITY;
+        queue->count--;
+        pthread_cond_signal(&(queue->not_full));
+    }
+    pthread_mutex_unlock(&(queue->mutex));
+    return doc;
+}
+
+static void
+bounded_queue_producer_done(struct bounded_queue *queue)
+{
+    pthread_mutex_lock(&(queue->mutex));
+    queue->num_producers--;
+    if (queue->num_producers == 0) {
+        pthread_cond_broadcast(&(queue->not_empty));
+    }
+    pthread_mutex_unlock(&(queue->mutex));
+}
+
+static void
+bounded_queue_destroy(struct bounded_queue *queue)
+{
+    pthread_cond_destroy(&(queue->not_full));
+    pthread_cond_destroy(&(queue->not_empty));
+    pthread_mutex_destroy(&(queue->mutex));
+}
+
+/* Free everything a document picked up on its way through the pipeline */
+static void
+document_finish(struct document *doc)
+{
+    if (doc->file_data != NULL) {
+        ctache_data_destroy(doc->file_data);
+        ctache_data_destroy(doc->empty);
+    }
+    free(doc->output);
+    free(doc->html);
+    unmap_file(&(doc->source));
+    free(doc->out_file_name);
+}
+
+/* A post whose output is already there only has to contribute its data */
+static void
+document_keep(struct pipeline *pipeline, struct document *doc)
+{
+    struct pipeline_arguments *args = pipeline->args;
+    if (doc->is_post) {
+        const char *in_file_name = doc->entry->in_path;
+        doc->empty = ctache_data_create_hash();
+        pthread_mutex_lock(args->data_mutex);
+        doc->file_data = ctache_data_merge_hashes(args->data, doc->empty);
+        pthread_mutex_unlock(args->data_mutex);
+        process_header_only(in_file_name, doc->file_data, NULL);
+        append_post_data(in_file_name,
+                         doc->file_data,
+                         pipeline->posts_arr,
+                         args->data_mutex,
+                         NULL);
+    }
+    document_finish(doc);
+}
+
+/* Write the output, unless the file already holds the same bytes */
+static void
+document_write(struct pipeline *pipeline,
+               struct document *doc,
+               const char *buf,
+               size_t len)
+{
+    const char *out_name;
+    int out_dir_fd = dir_cache_parent(pipeline->args->dirs,
+                                      doc->out_file_name,
+                                      &out_name);
+    enum file_change change = write_file_if_changed_at(out_dir_fd,
+                                                       out_name,
+                                                       buf,
+                                                       len);
+    if (change != FILE_UNCHANGED) {
+        changes_record(pipeline->args->changes,
+                       change,
+                       doc->out_file_name,
+                       hash_bytes(HASH_INIT, buf, len));
+    }
+}
+
+/* I/O: map a text file into memory, or copy any other file straight out */
+static bool
+stage_read(struct pipeline *pipeline, struct document *doc)
+{
+    const char *in_file_name = doc->entry->in_path;
+
+    if (doc->entry->up_to_date) {
+        document_keep(pipeline, doc);
+        return false;
+    }
+
+    char *extension = file_extension(in_file_name, NULL);
+    bool is_text = extension_implies_text(extension);
+    doc->is_markdown = extension_implies_markdown(extension);
+    free(extension);
+
+    /* Whatever was kept mapped from checking the file is now the document's */
+    if (doc->entry->source.data != NULL) {
+        map_file_or_take(in_file_name, &(doc->entry->source), &(doc->source));
+    }
+
+    /* Posts go straight to the index.html file in their own directories */
+    doc->out_file_name = final_out_file_name(in_file_name,
+                                             doc->entry->site_dir,
+                                             doc->is_post,
+                                             NULL);
+
+    if (!is_text) {
+        const char *out_name;
+        dir_cache_parent(pipeline->args->dirs, doc->out_file_name, &out_name);
+        publish_entry(doc->entry,
+                      doc->out_file_name,
+                      pipeline->args->assets,
+                      pipeline->args->changes);
+        document_finish(doc);
+        return false;
+    }
+
+    /* Reuse the output of any earlier build of the same content */
+    size_t cached_len;
+    char *cached = cache_load(pipeline->args->cache,
+                              &(doc->entry->cache_key),
+                              &cached_len);
+    if (cached != NULL) {
+        document_write(pipeline, doc, cached, cached_len);
+        free(cached);
+        document_keep(pipeline, doc);
+        return false;
+    }
+
+    if (doc->source.data == NULL
+        && !map_file(in_file_name, &(doc->source))) {
+        char *err_fmt = "ERROR: Could not open input file %s\n";
+        fprintf(stderr, err_fmt, in_file_name);
+        document_finish(doc);
+        return false;
+    }
+
+    return true;
+}
+
+/* CPU: read the header data, populate the file ctache_data_t hash */
+static bool
+stage_front_matter(struct pipeline *pipeline, struct document *doc)
+{
+    struct pipeline_arguments *args = pipeline->args;
+
+    doc->empty = ctache_data_create_hash();
+    pthread_mutex_lock(args->data_mutex);
+    doc->file_data = ctache_data_merge_hashes(args->data, doc->empty);
+    pthread_mutex_unlock(args->data_mutex);
+
+    size_t header_len = cytogen_header_read_from_span(doc->source.data,
+                                                      doc->source.len,
+                                                      doc->file_data,
+                                                      NULL);
+    if (header_len > doc->source.len) {
+        header_len = doc->source.len;
+    }
+    doc->body = doc->source.data + header_len;
+    doc->body_len = doc->source.len - header_len;
+
+    return true;
+}
+
+/* CPU: if necessary render the body as markdown */
+static bool
+stage_markdown(struct pipeline *pipeline, struct document *doc)
+{
+    (void) pipeline;
+    if (doc->is_markdown) {
+        size_t html_len;
+        doc->html = render_markdown_string(doc->entry->in_path,
+                                           doc->body,
+                                           doc->body_len,
+                                           &html_len);
+        doc->body = doc->html;
+        doc->body_len = html_len;
+    }
+    return true;
+}
+
+/* CPU: render the body through ctache and its layout */
+static bool
+stage_template(struct pipeline *pipeline, struct document *doc)
+{
+    struct pipeline_arguments *args = pipeline->args;
+    FILE *out_fp = open_memstream(&(doc->output), &(doc->output_len));
+    if (out_fp == NULL) {
+        fprintf(stderr, "ERROR: Could not open memory stream\n");
+        abort();
+    }
+    render_ctache_string(doc->body,
+                         doc->body_len,
+                         out_fp,
+                         args->layouts,
+                         args->num_layouts,
+                         doc->file_data);
+    fclose(out_fp);
+    return true;
+}
+
+/* I/O: write the rendered output to the site */
+static bool
+stage_write(struct pipeline *pipeline, struct document *doc)
+{
+    document_write(pipeline, doc, doc->output, doc->output_len);
+    cache_store(pipeline->args->cache,
+                &(doc->entry->cache_key),
+                doc->output,
+                doc->output_len);
+
+    if (doc->is_post) {
+        append_post_data(doc->entry->in_path,
+                         doc->file_data,
+                         pipeline->posts_arr,
+                         pipeline->args->data_mutex,
+                         NULL);
+    }
+
+    document_finish(doc);
+    return false;
+}
+
+static void
+*stage_worker(void *stage_ptr)
+{
+    struct pipeline_stage *stage = (struct pipeline_stage *) stage_ptr;
+    struct pipeline *pipeline = stage->pipeline;
+    struct document *doc;
+
+    while (1) {
+        if (stage->in == NULL) {
+            doc = work_queue_next(&(pipeline->documents));
+        } else {
+            doc = bounded_queue_pop(stage->in);
+        }
+        if (doc == NULL) {
+            break;
+        }
+        if (stage->func(pipeline, doc) && stage->out != NULL) {
+            bounded_queue_push(stage->out, doc);
+        }
+    }
+
+    if (stage->out != NULL) {
+        bounded_queue_producer_done(stage->out);
+    }
+    return NULL;
+}
+
+void
+pipeline_run(struct pipeline_arguments *args)
+{
+    struct pipeline pipeline;
+    int num_documents = args->num_posts + args->num_pages;
+    size_t size = sizeof(struct document) * (num_documents + 1);
+    struct document *documents = malloc(size);
+    void **items = malloc(sizeof(void *) * (num_documents + 1));
+    int i;
+
+    /* Posts go first since the pages that list them are waiting on them */
+    memset(documents, 0, size);
+    for (i = 0; i < num_documents; i++) {
+        struct document *doc = &(documents[i]);
+        if (i < args->num_posts) {
+            doc->entry = args->posts[i];
+            doc->is_post = true;
+        } else {
+            doc->entry = args->pages[i - args->num_posts];
+            doc->is_post = false;
+        }
+        items[i] = doc;
+    }
+
+    pipeline.args = args;
+    pipeline.posts_arr = ctache_data_hash_table_get(args->data, POSTS_KEY);
+    work_queue_init(&(pipeline.documents), items, num_documents);
+
+    bool (*funcs[NUM_STAGES])(struct pipeline *, struct document *) = {
+        stage_read,
+        stage_front_matter,
+        stage_markdown,
+        stage_template,
+        stage_write
+    };
+    int num_workers[NUM_STAGES] = {
+        args->num_io_workers,
+        args->num_cpu_workers,
+        args->num_cpu_workers,
+        args->num_cpu_workers,
+        args->num_io_workers
+    };
+
+    int total_workers = 0;
+    for (i = 0; i < NUM_STAGES; i++) {
+        struct pipeline_stage *stage = &(pipeline.stages[i]);
+        stage->func = funcs[i];
+        stage->num_workers = num_workers[i];
+        stage->in = i > 0 ? &(pipeline.queues[i - 1]) : NULL;
+        stage->out = i < NUM_STAGES - 1 ? &(pipeline.queues[i]) : NULL;
+        stage->pipeline = &pipeline;
+        if (stage->out != NULL) {
+            bounded_queue_init(stage->out, stage->num_workers);
+        }
+        total_workers += stage->num_workers;
+    }
+
+    /*
+     * Start every stage, then wait for the documents to drain through. The
+     * stages get threads of their own rather than jobs on the build's thread
+     * pool, since each one blocks on the queues of its neighbours, so they
+     * all have to run at once, and there are more of them than the pool has
+     * threads.
+     */
+    pthread_t *threads = malloc(sizeof(pthread_t) * total_workers);
+    int thread_index = 0;
+    for (i = 0; i < NUM_STAGES; i++) {
+        struct pipeline_stage *stage = &(pipeline.stages[i]);
+        int j;
+        for (j = 0; j < stage->num_workers; j++) {
+            pthread_create(&(threads[thread_index]), NULL, stage_worker, stage);
+            thread_index++;
+        }
+    }
+    for (i = 0; i < total_workers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    /* Clean up */
+    for (i = 0; i < NUM_STAGES - 1; i++) {
+        bounded_queue_destroy(&(pipeline.queues[i]));
+    }
+    work_queue_destroy(&(pipeline.documents));
+    free(threads);
+    free(items);
+    free(documents);
+}
@@ -0,0 +1,48 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Copyright (c) 2026 David Jackson
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "layout.h"
+#include "inventory.h"
+#include "cache.h"
+#include "changes.h"
+#include "processing.h"
+#include <pthread.h>
+#include <ctache/ctache.h>
+
+/*
+ * In pipelined mode every file goes through a series of stages (read, front
+ * matter, markdown, template, write), each run by its own set of workers and
+ * connected to the next by a bounded queue. The I/O stages and the CPU stages
+ * therefore overlap instead of taking turns on the same thread.
+ */
+struct pipeline_arguments {
+    struct inventory_entry **posts;
+    int num_posts;
+    struct inventory_entry **pages;
+    int num_pages;
+    ctache_data_t *data;
+    pthread_mutex_t *data_mutex;
+    struct layout *layouts;
+    int num_layouts;
+    int num_io_workers;
+    int num_cpu_workers;
+    struct cache *cache; /* The render cache, or NULL */
+    struct changes *changes; /* Where to record changed outputs, or NULL */
+    enum asset_mode assets;
+    struct dir_cache *dirs; /* The output directories, or NULL */
+};
+
+void
+pipeline_run(struct pipeline_arguments *args);
+
+#endif /* PIPELINE_H */
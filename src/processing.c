@@ -5,7 +5,7 @@
  */
 
 /*
- * Copyright (c) 2016-2021 David Jackson
+ * Copyright (c) 2016-2026 David Jackson
  */
 
 #include "config.h"
@@ -15,14 +15,18 @@
 #include "render.h"
 #include "processing.h"
 #include "files.h"
+#include "inventory.h"
 #include "string_util.h"
 #include "cytogen_header.h"
 #include "cymkd.h"
+#include "hash.h"
 #include <pthread.h>
 #include <ctache/ctache.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <dirent.h>
 #include <libgen.h>
 #include <time.h>
 #include <sys/param.h>
@@ -30,37 +34,389 @@
 #include <libgen.h>
 #endif /* HAVE_BASENAME_R */
 
-#define CHUNK_SIZE 512
-
-typedef unsigned char byte;
-
 char
 *determine_out_file_name(const char *in_file_name,
-                         const char *site_dir)
+                         const char *site_dir,
+                         struct arena *arena)
 {
-    char *in_file_name_dup;
     char *out_file_name;
     size_t out_file_name_len;
     char in_file_base_name[MAXPATHLEN];
 
-    in_file_name_dup = strdup(in_file_name);
-    basename_r(in_file_name_dup, in_file_base_name);
+    basename_r(in_file_name, in_file_base_name);
 
     out_file_name_len = strlen(site_dir) + 1 + strlen(in_file_base_name);
-    out_file_name = malloc(out_file_name_len + 1);
+    out_file_name = arena_alloc(arena, out_file_name_len + 1);
     strcpy(out_file_name, site_dir);
     strcat(out_file_name, "/");
     strcat(out_file_name, in_file_base_name);
-    if (out_file_name == NULL) {
-        fprintf(stderr, "ERROR: Could not malloc() for out_file_name\n");
-        return NULL;
+
+    return out_file_name;
+}
+
+/*
+ * Copy a (binary) file to the site as-is, unless it is there already. A copy
+ * is given the mtime of its source, so that it can later be seen to be up to
+ * date from its size and mtime alone, without reading either file. Tools that
+ * sync the site elsewhere by size and mtime then skip it as well.
+ */
+enum file_change
+copy_file(const char *in_file_name, const char *out_file_name)
+{
+    int in_fd = open(in_file_name, O_RDONLY);
+    struct stat in_statbuf;
+    if (in_fd == -1 || fstat(in_fd, &in_statbuf) == -1) {
+        char *err_fmt = "ERROR: Could not open input file %s\n";
+        fprintf(stderr, err_fmt, in_file_name);
+        if (in_fd != -1) {
+            close(in_fd);
+        }
+        return FILE_UNCHANGED;
+    }
+
+    struct stat statbuf;
+    bool existed = lstat(out_file_name, &statbuf) == 0;
+    if (existed && (S_ISLNK(statbuf.st_mode) || statbuf.st_nlink > 1)) {
+        /* Never write through a link left by publishing assets as links */
+        unlink(out_file_name);
+    } else if (existed
+               && statbuf.st_size == in_statbuf.st_size
+               && statbuf.st_mtim.tv_sec == in_statbuf.st_mtim.tv_sec
+               && statbuf.st_mtim.tv_nsec == in_statbuf.st_mtim.tv_nsec) {
+        close(in_fd);
+        return FILE_UNCHANGED;
+    } else if (existed
+               && statbuf.st_size == in_statbuf.st_size
+               && files_have_same_contents(in_file_name, out_file_name)) {
+        close(in_fd); /* Keep its mtime, which sync tools have already seen */
+        return FILE_UNCHANGED;
+    }
+    int out_fd = open(out_file_name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (out_fd == -1) {
+        fprintf(stderr,
+                "ERROR: Could not open for writing: %s\n",
+                out_file_name);
+        abort();
+    }
+    struct timespec times[2] = { in_statbuf.st_atim, in_statbuf.st_mtim };
+    if (!copy_file_data(in_fd, out_fd)
+        || futimens(out_fd, times) != 0
+        || close(out_fd) != 0) {
+        fprintf(stderr, "ERROR: Could not copy %s\n", in_file_name);
+        abort();
+    }
+    close(in_fd);
+    return existed ? FILE_MODIFIED : FILE_ADDED;
+}
+
+/*
+ * The target for a symlink from the output to the input. It is relative, so
+ * that it still holds when the site directory is renamed, as it is by a staged
+ * build, or the project is moved.
+ */
+static char
+*asset_link_target(const char *in_file_name, const char *out_file_name)
+{
+    if (in_file_name[0] == '/' || out_file_name[0] == '/') {
+        return realpath(in_file_name, NULL);
+    }
+    while (strncmp(in_file_name, "./", 2) == 0) {
+        in_file_name += 2;
+    }
+    size_t depth = 0;
+    const char *ch;
+    for (ch = out_file_name; *ch != '\0'; ch++) {
+        if (*ch == '/') {
+            depth++;
+        }
+    }
+    char *target = malloc(depth * 3 + strlen(in_file_name) + 1);
+    target[0] = '\0';
+    size_t i;
+    for (i = 0; i < depth; i++) {
+        strcat(target, "../");
     }
+    strcat(target, in_file_name);
+    return target;
+}
+
+/* Whether the file is a symlink to the target */
+static bool
+is_link_to(const char *file_name, const char *target)
+{
+    size_t target_len = strlen(target);
+    char buf[MAXPATHLEN];
+    ssize_t len = readlink(file_name, buf, sizeof(buf));
+    return len >= 0
+        && (size_t) len == target_len
+        && strncmp(buf, target, target_len) == 0;
+}
 
-    free(in_file_name_dup);
+/*
+ * Publish a binary file to the site as a hard link or symlink to its source,
+ * so that no bytes are copied, or as a copy. Where the link cannot be made,
+ * e.g. a hard link across filesystems, the file is copied instead. A link
+ * that is already there shares the source's contents, so whether the output
+ * changed is whether the source did, which the caller has to say.
+ */
+enum file_change
+publish_asset(const char *in_file_name,
+              const char *out_file_name,
+              enum asset_mode mode,
+              bool source_changed)
+{
+    enum file_change kept = source_changed ? FILE_MODIFIED : FILE_UNCHANGED;
+    if (mode == ASSETS_COPY) {
+        return copy_file(in_file_name, out_file_name);
+    }
 
+    struct stat out_statbuf;
+    bool existed = lstat(out_file_name, &out_statbuf) == 0;
+    bool linked;
+    if (mode == ASSETS_HARDLINK) {
+        struct stat in_statbuf;
+        if (stat(in_file_name, &in_statbuf) != 0) {
+            char *err_fmt = "ERROR: Could not open input file %s\n";
+            fprintf(stderr, err_fmt, in_file_name);
+            return FILE_UNCHANGED;
+        }
+        if (existed
+            && out_statbuf.st_dev == in_statbuf.st_dev
+            && out_statbuf.st_ino == in_statbuf.st_ino) {
+            return kept;
+        }
+        if (existed) {
+            unlink(out_file_name);
+        }
+        linked = link(in_file_name, out_file_name) == 0;
+    } else {
+        char *target = asset_link_target(in_file_name, out_file_name);
+        if (target == NULL) {
+            char *err_fmt = "ERROR: Could not open input file %s\n";
+            fprintf(stderr, err_fmt, in_file_name);
+            return FILE_UNCHANGED;
+        }
+        if (existed
+            && S_ISLNK(out_statbuf.st_mode)
+            && is_link_to(out_file_name, target)) {
+            free(target);
+            return kept;
+        }
+        if (existed) {
+            unlink(out_file_name);
+        }
+        linked = symlink(target, out_file_name) == 0;
+        free(target);
+    }
+
+    if (!linked) {
+        enum file_change change = copy_file(in_file_name, out_file_name);
+        return existed && change == FILE_ADDED ? FILE_MODIFIED : change;
+    }
+    return existed ? FILE_MODIFIED : FILE_ADDED;
+}
+
+/* Remove a file, or a directory along with everything in it */
+static void
+remove_path(const char *path)
+{
+    struct stat statbuf;
+    if (lstat(path, &statbuf) != 0) {
+        return;
+    }
+    if (!S_ISDIR(statbuf.st_mode)) {
+        unlink(path);
+        return;
+    }
+    DIR *dir = opendir(path);
+    struct dirent *dirent;
+    while (dir != NULL && (dirent = readdir(dir)) != NULL) {
+        if (strcmp(dirent->d_name, ".") == 0
+            || strcmp(dirent->d_name, "..") == 0) {
+            continue;
+        }
+        char *child;
+        asprintf(&child, "%s/%s", path, dirent->d_name);
+        remove_path(child);
+        free(child);
+    }
+    if (dir != NULL) {
+        closedir(dir);
+    }
+    rmdir(path);
+}
+
+/* Bring one file of a synced directory up to date */
+static void
+sync_file(const char *in_file_name,
+          const char *out_file_name,
+          struct stat *in_statbuf)
+{
+    struct stat out_statbuf;
+    bool existed = lstat(out_file_name, &out_statbuf) == 0;
+    if (existed
+        && S_ISDIR(out_statbuf.st_mode) != S_ISDIR(in_statbuf->st_mode)) {
+        remove_path(out_file_name);
+        existed = false;
+    }
+
+    if (S_ISDIR(in_statbuf->st_mode)) {
+        if (!existed) {
+            mkdir(out_file_name, 0770);
+        }
+        sync_directory(in_file_name, out_file_name);
+    } else if (S_ISLNK(in_statbuf->st_mode)) {
+        char target[MAXPATHLEN];
+        ssize_t len = readlink(in_file_name, target, sizeof(target) - 1);
+        if (len < 0) {
+            return;
+        }
+        target[len] = '\0';
+        if (!(existed && is_link_to(out_file_name, target))) {
+            unlink(out_file_name);
+            symlink(target, out_file_name);
+        }
+    } else if (in_statbuf->st_nlink > 1) {
+        /* An asset published as a hard link to its source */
+        if (!(existed
+              && out_statbuf.st_dev == in_statbuf->st_dev
+              && out_statbuf.st_ino == in_statbuf->st_ino)) {
+            unlink(out_file_name);
+            if (link(in_file_name, out_file_name) != 0) {
+                copy_file(in_file_name, out_file_name);
+            }
+        }
+    } else {
+        copy_file(in_file_name, out_file_name);
+    }
+}
+
+/*
+ * Bring a directory up to date with another, e.g. the staging directory with
+ * the site that was published from it last, copying only the files that
+ * differ and removing those that are gone. Links are made again as links, so
+ * that assets published as links stay so.
+ */
+void
+sync_directory(const char *in_dir_name, const char *out_dir_name)
+{
+    DIR *dir = opendir(in_dir_name);
+    if (dir == NULL) {
+        return;
+    }
+    mkdir(out_dir_name, 0770); /* It may well exist already */
+    struct dirent *dirent;
+    while ((dirent = readdir(dir)) != NULL) {
+        if (strcmp(dirent->d_name, ".") == 0
+            || strcmp(dirent->d_name, "..") == 0) {
+            continue;
+        }
+        char *in_file_name;
+        char *out_file_name;
+        asprintf(&in_file_name, "%s/%s", in_dir_name, dirent->d_name);
+        asprintf(&out_file_name, "%s/%s", out_dir_name, dirent->d_name);
+        struct stat in_statbuf;
+        if (lstat(in_file_name, &in_statbuf) == 0) {
+            sync_file(in_file_name, out_file_name, &in_statbuf);
+        }
+        free(out_file_name);
+        free(in_file_name);
+    }
+    closedir(dir);
+
+    /* Remove what the other directory does not have */
+    dir = opendir(out_dir_name);
+    while (dir != NULL && (dirent = readdir(dir)) != NULL) {
+        if (strcmp(dirent->d_name, ".") == 0
+            || strcmp(dirent->d_name, "..") == 0) {
+            continue;
+        }
+        char *in_file_name;
+        char *out_file_name;
+        asprintf(&in_file_name, "%s/%s", in_dir_name, dirent->d_name);
+        asprintf(&out_file_name, "%s/%s", out_dir_name, dirent->d_name);
+        struct stat in_statbuf;
+        if (lstat(in_file_name, &in_statbuf) != 0) {
+            remove_path(out_file_name);
+        }
+        free(out_file_name);
+        free(in_file_name);
+    }
+    if (dir != NULL) {
+        closedir(dir);
+    }
+}
+
+/*
+ * Publish a binary file and record what that did to its output, whose
+ * contents are the same as the source's however it is published. A file that
+ * the check against the last build found to be new or resized was left for
+ * the worker publishing it to hash.
+ */
+void
+publish_entry(struct inventory_entry *entry,
+              const char *out_file_name,
+              enum asset_mode mode,
+              struct changes *changes)
+{
+    if (entry->hash == 0 && !hash_file(entry->in_path, &(entry->hash))) {
+        entry->hash = 0;
+    }
+    enum file_change change = publish_asset(entry->in_path,
+                                            out_file_name,
+                                            mode,
+                                            entry->source_changed);
+    if (change != FILE_UNCHANGED) {
+        changes_record(changes, change, out_file_name, entry->hash);
+    }
+}
+
+/*
+ * The path a file's output is written to, i.e. with the markdown output's
+ * .html extension, or the index.html file in its own directory for a post.
+ */
+char
+*final_out_file_name(const char *in_file_name,
+                     const char *site_dir,
+                     bool is_post,
+                     struct arena *arena)
+{
+    char *out_file_name;
+    if (is_post) {
+        char *url = post_url(in_file_name, arena);
+        out_file_name = arena_asprintf(arena, "%s%s/index.html", site_dir, url);
+        arena_free(arena, url);
+    } else {
+        char *extension = file_extension(in_file_name, arena);
+        out_file_name = determine_out_file_name(in_file_name, site_dir, arena);
+        if (extension_implies_markdown(extension)) {
+            char *html_file_name = arena_asprintf(arena,
+                                                  "%s.html",
+                                                  out_file_name);
+            arena_free(arena, out_file_name);
+            out_file_name = html_file_name;
+        }
+        arena_free(arena, extension);
+    }
     return out_file_name;
 }
 
+/* Read only the header data of a file whose output is already up to date */
+void
+process_header_only(const char *in_file_name,
+                    ctache_data_t *file_data,
+                    struct arena *arena)
+{
+    struct mapped_file in_file;
+    if (!map_file(in_file_name, &in_file)) {
+        char *err_fmt = "ERROR: Could not open input file %s\n";
+        fprintf(stderr, err_fmt, in_file_name);
+        return;
+    }
+    cytogen_header_read_from_span(in_file.data, in_file.len, file_data, arena);
+    unmap_file(&in_file);
+}
+
 void
 process_file(const char *in_file_name,
              struct process_file_args *args,
@@ -70,119 +426,118 @@ process_file(const char *in_file_name,
     char *out_file_name;
     const char *site_dir = args->site_dir;
 
-    in_file_extension = file_extension(in_file_name);
-    out_file_name = determine_out_file_name(in_file_name,
-                                            site_dir);
+    /* Posts go straight to the index.html file in their own directories */
+    in_file_extension = file_extension(in_file_name, &(args->arena));
+    out_file_name = final_out_file_name(in_file_name,
+                                        site_dir,
+                                        args->is_post,
+                                        &(args->arena));
 
     bool is_markdown = false;
     is_markdown = extension_implies_markdown(in_file_extension);
 
     bool is_text = extension_implies_text(in_file_extension);
 
-    const char *ctache_file_name = in_file_name;
-    FILE *in_fp = fopen(ctache_file_name, "r");
-    if (in_fp != NULL && is_text) {
-        /* Read the header data, populate the file ctache_data_t hash */
-        cytogen_header_read_from_file(in_fp, file_data);
+    /* Make the output's directory, if this build has not already */
+    const char *out_name;
+    int out_dir_fd = dir_cache_parent(args->dirs, out_file_name, &out_name);
 
-        /* If necessary render the output file as markdown */
-        char *html_file_name = NULL;
-        if (is_markdown) {
-            char *markdown_file_name = out_file_name;
-            render_markdown(in_fp, markdown_file_name, &html_file_name);
-
-            fclose(in_fp);
-            in_fp = NULL;
+    if (!is_text) {
+        publish_entry(args->entry, out_file_name, args->assets, args->changes);
+        return;
+    }
 
-            in_fp = fopen(html_file_name, "r");
-        }
+    /*
+     * The file is mapped, unless it was kept mapped from checking it, and
+     * every stage works on spans of the mapping
+     */
+    struct mapped_file in_file;
+    if (!map_file_or_take(in_file_name, &(args->entry->source), &in_file)) {
+        char *err_fmt = "ERROR: Could not open input file %s\n";
+        fprintf(stderr, err_fmt, in_file_name);
+        return;
+    }
 
-        /* Render the file */
-        FILE *out_fp = fopen(out_file_name, "w");
+    /* Read the header data, populate the file ctache_data_t hash */
+    size_t header_len = cytogen_header_read_from_span(in_file.data,
+                                                      in_file.len,
+                                                      file_data,
+                                                      &(args->arena));
+    if (header_len > in_file.len) {
+        header_len = in_file.len;
+    }
+    const char *body = in_file.data + header_len;
+    size_t body_len = in_file.len - header_len;
+
+    /* Reuse the output of any earlier build of the same content */
+    size_t output_len;
+    char *output = cache_load(args->cache, args->cache_key, &output_len);
+    if (output == NULL) {
+        FILE *out_fp = open_memstream(&output, &output_len);
         if (out_fp == NULL) {
-            fprintf(stderr,
-                    "ERROR: Could not open for writing: %s\n",
-                    out_file_name);
+            fprintf(stderr, "ERROR: Could not open memory stream\n");
             abort();
         }
-        render_ctache_file(in_fp,
-                           out_fp,
-                           args->layouts,
-                           args->num_layouts,
-                           file_data);
-        fclose(out_fp);
-        out_fp = NULL;
 
-        /* Clean up files created by the markdown rendering */
+        /* Render the file, as markdown first if necessary */
         if (is_markdown) {
-            unlink(html_file_name);
-            rename(out_file_name, html_file_name);
+            size_t html_len;
+            char *html = render_markdown_string(in_file_name,
+                                                body,
+                                                body_len,
+                                                &html_len);
+            render_ctache_string(html,
+                                 html_len,
+                                 out_fp,
+                                 args->layouts,
+                                 args->num_layouts,
+                                 file_data);
+            free(html);
+        } else {
+            render_ctache_string(body,
+                                 body_len,
+                                 out_fp,
+                                 args->layouts,
+                                 args->num_layouts,
+                                 file_data);
         }
+        fclose(out_fp);
 
-        free(html_file_name);
-        fclose(in_fp); 
-    } else if (in_fp != NULL && !is_text) {
-        fclose(in_fp);
-        in_fp = fopen(in_file_name, "rb");
-	byte chunk[CHUNK_SIZE];
-        FILE *out_fp = fopen(out_file_name, "wb");
-        if (out_fp == NULL) {
-            fprintf(stderr,
-                    "ERROR: Could not open for writing: %s\n",
-                    out_file_name);
-            abort();
-        }
-	struct stat statbuf;
-	stat(in_file_name, &statbuf);
-	off_t file_size = statbuf.st_size;
-	size_t data_read;
-	size_t data_written;
-	size_t total_read = 0;
-	size_t nmemb_read = 0;
-	size_t write_chunk = CHUNK_SIZE;
-	while (!feof(in_fp)) {
-	    nmemb_read = fread(chunk, CHUNK_SIZE, 1, in_fp);
-	    if (nmemb_read == 0 && ferror(in_fp)) {
-                perror("fread");
-                fprintf(stderr, "Error reading file\n");
-                abort();
-            }
-	    if (total_read + CHUNK_SIZE > file_size) {
-		    write_chunk = file_size - total_read;
-	    }
-	    total_read += CHUNK_SIZE;
-            data_written = fwrite(chunk, write_chunk, 1, out_fp);
-	    if (data_written == 0) {
-                perror("fwrite");
-                fprintf(stderr, "Error writing file\n");
-                abort();
-	    }
-	}
-	fclose(out_fp);
-	fclose(in_fp);
-    } else {
-        char *err_fmt = "ERROR: Could not open input file %s\n";
-        fprintf(stderr, err_fmt, ctache_file_name);
+        cache_store(args->cache, args->cache_key, output, output_len);
     }
-
-    /* Final cleanup */
-    free(out_file_name);
-    free(in_file_extension);
+    unmap_file(&in_file);
+
+    enum file_change change = write_file_if_changed_at(out_dir_fd,
+                                                       out_name,
+                                                       output,
+                                                       output_len);
+    if (change != FILE_UNCHANGED) {
+        changes_record(args->changes,
+                       change,
+                       out_file_name,
+                       hash_bytes(HASH_INIT, output, output_len));
+    }
+    free(output);
 }
 
 void
 *process_files(void *args_ptr)
 {
     struct process_file_args *args = (struct process_file_args *)args_ptr;
-    int i;
-    char *in_file_name;
-    for (i = args->start_index; i < args->end_index; i++) {
-        in_file_name = (args->file_names)[i];
+    struct inventory_entry *entry;
+    while ((entry = work_queue_next(args->queue)) != NULL) {
         ctache_data_t *empty = ctache_data_create_hash();
+        pthread_mutex_lock(args->data_mutex);
         ctache_data_t *file_data = ctache_data_merge_hashes(args->data, empty);
-        process_file(in_file_name, args, file_data);
+        pthread_mutex_unlock(args->data_mutex);
+        args->site_dir = entry->site_dir;
+        args->entry = entry;
+        args->cache_key = &(entry->cache_key);
+        args->is_post = false;
+        process_file(entry->in_path, args, file_data);
         ctache_data_destroy(file_data);
         ctache_data_destroy(empty);
+        arena_reset(&(args->arena));
     }
     return NULL;
 }
@@ -193,17 +548,13 @@ date_from_file_name(const char *file_name)
     time_t date;
     struct tm date_tm;
     char file_name_base[MAXPATHLEN];
-    char *file_name_date_portion;
 
     basename_r(file_name, file_name_base);
-    file_name_date_portion = strdup(file_name_base);
-    file_name_date_portion[10] = '\0'; /* First 10 chars are YYYY-MM-DD */
+    file_name_base[10] = '\0'; /* First 10 chars are YYYY-MM-DD */
     memset(&date_tm, 0, sizeof(struct tm));
-    strptime(file_name_date_portion, "%Y-%m-%d", &date_tm);
+    strptime(file_name_base, "%Y-%m-%d", &date_tm);
     date = mktime(&date_tm);
 
-    free(file_name_date_portion);
-
     return date;
 }
 
@@ -233,87 +584,72 @@ get_post_directory(const char *post_file_name, char *post_dir)
 }
 
 char
-*post_url(const char *file_name)
+*post_url(const char *file_name, struct arena *arena)
 {
     char *url;
     time_t date;
     char file_name_base[MAXPATHLEN];
-    char *file_name_without_date;
-    char *file_name_dup;
+    char file_name_without_date[MAXPATHLEN];
     char url_date[11]; /* YYYY-mm-dd */
     struct tm date_tm;
 
     date = date_from_file_name(file_name);
     localtime_r(&date, &date_tm);
 
-    file_name_dup = strdup(file_name);
     /* file_name_base is the file name after the date */
-    basename_r(file_name_dup, file_name_base);
-    file_name_without_date = malloc(strlen(file_name_base) + 1);
+    basename_r(file_name, file_name_base);
     get_post_directory(file_name_base, file_name_without_date);
 
     char parent_dir[] = "/posts/YYYY/mm/dd/";
-    url = malloc(strlen(parent_dir) + strlen(file_name_without_date) + 1);
+    url = arena_alloc(arena,
+                      strlen(parent_dir) + strlen(file_name_without_date) + 1);
     strftime(url_date, 11, "%Y/%m/%d", &date_tm);
     strcpy(url, "/posts/");
     strcat(url, url_date);
     strcat(url, "/");
     strcat(url, file_name_without_date);
 
-    free(file_name_without_date);
-    free(file_name_dup);
-
     return url;
 }
 
-static char
-*prepare_post_directory(const char *site_dir,
-                        const char *post_file_name)
+/* Add a processed post's title, date and URL to the posts array */
+void
+append_post_data(const char *in_file_name,
+                 ctache_data_t *file_data,
+                 ctache_data_t *posts_arr,
+                 pthread_mutex_t *data_mutex,
+                 struct arena *arena)
 {
     time_t date;
-    struct tm date_tm;
-    int year, month, day;
-    struct stat statbuf;
-    char *dir;
+    char *url;
+    ctache_data_t *tmp_data;
 
-    date = date_from_file_name(post_file_name);
-    localtime_r(&date, &date_tm);
-    year = date_tm.tm_year + 1900;
-    month = date_tm.tm_mon + 1;
-    day = date_tm.tm_mday;
-
-    /* Create the base directory if it doesn't exist */
-    asprintf(&dir, "%s/posts", site_dir);
-    mkdir(dir, 0770);
-    free(dir);
-
-    /* Create the year directory if it doesn't exist */
-    asprintf(&dir, "%s/posts/%4d", site_dir, year);
-    mkdir(dir, 0770);
-    free(dir);
-
-    /* Create the month directory if it doesn't exist */
-    asprintf(&dir, "%s/posts/%4d/%02d", site_dir, year, month);
-    mkdir(dir, 0770);
-    free(dir);
-
-    /* Create the day directory if it doesn't exist */
-    asprintf(&dir, "%s/posts/%4d/%02d/%02d", site_dir, year, month, day);
-    mkdir(dir, 0770);
-    free(dir);
-
-    /* Create the post directory if it doesn't exist */
-    char *file_name_dup = strdup(post_file_name);
-    char post[MAXPATHLEN];
-    char file_name_base[MAXPATHLEN];
-    basename_r(file_name_dup, file_name_base);
-    get_post_directory(file_name_base, post);
-    char fmt[] = "%s/posts/%4d/%02d/%02d/%s";
-    asprintf(&dir, fmt, site_dir, year, month, day, post);
-    mkdir(dir, 0770);
-    free(file_name_dup);
-
-    return dir;
+    ctache_data_t *post_data = ctache_data_create_hash();
+    if (!ctache_data_hash_table_has_key(file_data, "title")) {
+        fprintf(stderr, "ERROR: Post has no title: %s\n", in_file_name);
+        abort();
+    }
+
+    /* Post Title */
+    tmp_data = ctache_data_hash_table_get(file_data, "title");
+    ctache_data_hash_table_set(post_data, "title", tmp_data);
+    date = date_from_file_name(in_file_name);
+
+    /* Post Creation Date */
+    tmp_data = ctache_data_create_time(date);
+    ctache_data_hash_table_set(post_data, "date", tmp_data);
+
+    /* Post URL */
+    url = post_url(in_file_name, arena);
+    tmp_data = ctache_data_create_string(url, strlen(url));
+    ctache_data_hash_table_set(post_data, "url", tmp_data);
+
+    /* Add the post data to the posts array */
+    pthread_mutex_lock(data_mutex);
+    ctache_data_array_append(posts_arr, post_data);
+    pthread_mutex_unlock(data_mutex);
+
+    arena_free(arena, url);
 }
 
 void
@@ -321,52 +657,36 @@ void
 {
     struct process_file_args *args = (struct process_file_args *)args_ptr;
     ctache_data_t *posts_arr = ctache_data_hash_table_get(args->data, "posts");
-    int i;
+    struct inventory_entry *entry;
     char *in_file_name;
-    time_t date;
-    char *url;
-    ctache_data_t *tmp_data;
 
-    for (i = args->start_index; i < args->end_index; i++) {
-        in_file_name = (args->file_names)[i];
+    while ((entry = work_queue_next(args->queue)) != NULL) {
+        in_file_name = entry->in_path;
 	ctache_data_t *empty = ctache_data_create_hash();
+        pthread_mutex_lock(args->data_mutex);
         ctache_data_t *file_data = ctache_data_merge_hashes(args->data, empty);
+        pthread_mutex_unlock(args->data_mutex);
 
-        const char *site_dir = args->site_dir;
-        char *post_dir = prepare_post_directory(site_dir,
-                                                in_file_name);
-        args->site_dir = post_dir;
-        process_file(in_file_name, args, file_data);
-        args->site_dir = site_dir;
-
-        ctache_data_t *post_data = ctache_data_create_hash();
-        if (!ctache_data_hash_table_has_key(file_data, "title")) {
-            fprintf(stderr, "ERROR: Post has no title: %s\n", in_file_name);
-            abort();
+        if (entry->up_to_date) {
+            process_header_only(in_file_name, file_data, &(args->arena));
+        } else {
+            args->site_dir = entry->site_dir;
+            args->entry = entry;
+            args->cache_key = &(entry->cache_key);
+            args->is_post = true;
+            process_file(in_file_name, args, file_data);
+            args->site_dir = NULL;
         }
 
-        /* Post Title */
-        tmp_data = ctache_data_hash_table_get(file_data, "title");
-        ctache_data_hash_table_set(post_data, "title", tmp_data);
-        date = date_from_file_name(in_file_name);
-
-        /* Post Creation Date */
-        tmp_data = ctache_data_create_time(date);
-        ctache_data_hash_table_set(post_data, "date", tmp_data);
-
-        /* Post URL */
-        url = post_url(in_file_name);
-        tmp_data = ctache_data_create_string(url, strlen(url));
-        ctache_data_hash_table_set(post_data, "url", tmp_data);
-
-        /* Add the post data to the posts array */
-        pthread_mutex_lock(args->data_mutex);
-        ctache_data_array_append(posts_arr, post_data);
-        pthread_mutex_unlock(args->data_mutex);
+        append_post_data(in_file_name,
+                         file_data,
+                         posts_arr,
+                         args->data_mutex,
+                         &(args->arena));
 
-        free(url);
         ctache_data_destroy(file_data);
         ctache_data_destroy(empty);
+        arena_reset(&(args->arena));
     }
     return NULL;
 }
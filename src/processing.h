@@ -12,23 +12,84 @@
 #define PROCESSING_H
 
 #include "layout.h"
+#include "work_queue.h"
+#include "arena.h"
+#include "cache.h"
+#include "changes.h"
+#include "files.h"
+#include "dir_cache.h"
+#include "inventory.h"
 #include <pthread.h>
+#include <stdbool.h>
 #include <ctache/ctache.h>
 
+/* How binary files are published to the site */
+enum asset_mode {
+    ASSETS_COPY,
+    ASSETS_HARDLINK,
+    ASSETS_SYMLINK
+};
+
 struct process_file_args {
-    int start_index;
-    int end_index;
-    char **file_names;
+    struct work_queue *queue;
     ctache_data_t *data;
     pthread_mutex_t *data_mutex;
     struct layout *layouts;
     int num_layouts;
     const char *site_dir;
+    struct inventory_entry *entry; /* The current file */
+    struct cache *cache; /* The render cache, or NULL */
+    const struct cache_key *cache_key; /* The current file's, or NULL */
+    bool is_post; /* The current file is a post */
+    enum asset_mode assets;
+    struct dir_cache *dirs; /* The output directories, or NULL */
+    struct changes *changes; /* Where to record changed outputs, or NULL */
+    struct arena arena; /* Scratch memory, reset after each file */
 };
 
 char
 *determine_out_file_name(const char *in_file_name,
-                         const char *site_dir);
+                         const char *site_dir,
+                         struct arena *arena);
+
+enum file_change
+copy_file(const char *in_file_name, const char *out_file_name);
+
+enum file_change
+publish_asset(const char *in_file_name,
+              const char *out_file_name,
+              enum asset_mode mode,
+              bool source_changed);
+
+void
+sync_directory(const char *in_dir_name, const char *out_dir_name);
+
+void
+publish_entry(struct inventory_entry *entry,
+              const char *out_file_name,
+              enum asset_mode mode,
+              struct changes *changes);
+
+void
+append_post_data(const char *in_file_name,
+                 ctache_data_t *file_data,
+                 ctache_data_t *posts_arr,
+                 pthread_mutex_t *data_mutex,
+                 struct arena *arena);
+
+char
+*post_url(const char *file_name, struct arena *arena);
+
+char
+*final_out_file_name(const char *in_file_name,
+                     const char *site_dir,
+                     bool is_post,
+                     struct arena *arena);
+
+void
+process_header_only(const char *in_file_name,
+                    ctache_data_t *file_data,
+                    struct arena *arena);
 
 void
 process_file(const char *in_file_name,
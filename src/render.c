@@ -5,7 +5,7 @@
  */
 
 /*
- * Copyright (c) 2016-2021 David Jackson
+ * Copyright (c) 2016-2026 David Jackson
  */
 
 #include "config.h"
@@ -17,6 +17,7 @@
 #include "cymkd.h"
 #include <stdio.h>
 #include <string.h>
+#include <ctype.h>
 #include <ctache/ctache.h>
 
 #define DELIM_BEGIN "{{"
@@ -27,21 +28,19 @@
  * "content".
  */
 static void
-render_with_layout(FILE *in_fp,
-                   FILE *out_fp,
-                   struct layout *layouts,
-                   int num_layouts,
-                   ctache_data_t *file_data)
+render_with_layout_string(const char *content,
+                          size_t content_len,
+                          FILE *out_fp,
+                          struct layout *layouts,
+                          int num_layouts,
+                          ctache_data_t *file_data)
 {
-    char *content = read_file_contents(in_fp);
-    size_t content_len = strlen(content);
     ctache_data_t *content_data;
     content_data = ctache_data_create_string(content, content_len);
     ctache_data_hash_table_set(file_data, "content", content_data);
     ctache_data_t *layout_data = ctache_data_hash_table_get(file_data, LAYOUT);
-    char *str = strdup(ctache_data_string_buffer(layout_data));
-    char *layout_name = string_trim(str);
-    free(str);
+    char *layout_name = string_trim(ctache_data_string_buffer(layout_data),
+                                    NULL);
     char *layout = get_layout_content(layouts, num_layouts, layout_name);
     if (layout == NULL) {
         fprintf(stderr, "ERROR: Layout not found: \"%s\"\n", layout_name);
@@ -55,40 +54,103 @@ render_with_layout(FILE *in_fp,
                          ESCAPE_HTML,
                          DELIM_BEGIN,
                          DELIM_END);
-    free(content);
     free(layout_name);
 }
-    
+
+/* Render content that is already in memory, in its layout if it has one */
 void
-render_ctache_file(FILE *in_fp,
-                   FILE* out_fp,
-                   struct layout *layouts,
-                   int num_layouts,
-                   ctache_data_t *file_data)
+render_ctache_string(const char *content,
+                     size_t content_len,
+                     FILE *out_fp,
+                     struct layout *layouts,
+                     int num_layouts,
+                     ctache_data_t *file_data)
 {
     if (!ctache_data_hash_table_has_key(file_data, LAYOUT)) {
-        ctache_render_file(in_fp,
-                           out_fp,
-                           file_data,
-                           ESCAPE_HTML,
-                           DELIM_BEGIN,
-                           DELIM_END);
+        ctache_render_string(content,
+                             content_len,
+                             out_fp,
+                             file_data,
+                             ESCAPE_HTML,
+                             DELIM_BEGIN,
+                             DELIM_END);
     } else {
-        render_with_layout(in_fp, out_fp, layouts, num_layouts, file_data);
+        render_with_layout_string(content,
+                                  content_len,
+                                  out_fp,
+                                  layouts,
+                                  num_layouts,
+                                  file_data);
     }
 }
 
-void
-render_markdown(FILE *in_fp, const char *file_name, char **html_file_name_ptr)
+/*
+ * Determine whether the template_len bytes of a template, which need not end
+ * in a NUL, refer to the given name in any of its tags, e.g. as {{name}},
+ * {{#name}}, {{^name}}, {{{name}}} or {{& name}}, or as any part of a dotted
+ * name such as {{name.title}}. It errs on the side of finding a reference.
+ */
+bool
+template_references(const char *template,
+                    size_t template_len,
+                    const char *name)
 {
-    asprintf(html_file_name_ptr, "%s.html", file_name);
-    char *html_file_name = *html_file_name_ptr;
-    FILE *out_fp = fopen(html_file_name, "w");
+    size_t name_len = strlen(name);
+    const char *end = template + template_len;
+    const char *tag = template;
+    while ((tag = memmem(tag, end - tag, DELIM_BEGIN, strlen(DELIM_BEGIN)))
+           != NULL) {
+        tag += strlen(DELIM_BEGIN);
+        const char *tag_end = memmem(tag,
+                                     end - tag,
+                                     DELIM_END,
+                                     strlen(DELIM_END));
+        if (tag_end == NULL) {
+            break;
+        }
+        while (tag < tag_end && (*tag == '#' || *tag == '^' || *tag == '/'
+                                 || *tag == '&' || *tag == '{'
+                                 || *tag == '>' || isspace(*tag))) {
+            tag++;
+        }
+        const char *name_end = tag;
+        while (name_end < tag_end && !isspace(*name_end)
+               && *name_end != '}') {
+            name_end++;
+        }
+        const char *part = tag;
+        while (part < name_end) {
+            const char *part_end = memchr(part, '.', name_end - part);
+            if (part_end == NULL) {
+                part_end = name_end;
+            }
+            if ((size_t) (part_end - part) == name_len
+                && strncmp(part, name, name_len) == 0) {
+                return true;
+            }
+            part = part_end + 1;
+        }
+        tag = tag_end + strlen(DELIM_END);
+    }
+    return false;
+}
+
+/* Render markdown into a newly-allocated, NUL-terminated HTML string */
+char
+*render_markdown_string(const char *file_name,
+                        const char *str,
+                        size_t str_len,
+                        size_t *html_len_ptr)
+{
+    char *html = NULL;
+    size_t html_len = 0;
+    FILE *out_fp = open_memstream(&html, &html_len);
     if (out_fp == NULL) {
-        char *err_fmt = "ERROR: Could not open for writing: %s\n";
-        fprintf(stderr, err_fmt, html_file_name);
-        perror(NULL);
+        fprintf(stderr, "ERROR: Could not open memory stream\n");
+        abort();
     }
-    cymkd_render_file(file_name, in_fp, out_fp);
+    cymkd_render(file_name, str, str_len, out_fp);
     fclose(out_fp);
+    *html_len_ptr = html_len;
+    return html;
 }
@@ -5,24 +5,34 @@
  */
 
 /*
- * Copyright (c) 2016 David Jackson
+ * Copyright (c) 2016-2026 David Jackson
  */
 
 #ifndef RENDER_H
 #define RENDER_H
 
 #include <stdio.h>
+#include <stdbool.h>
 #include "layout.h"
 #include <ctache/ctache.h>
 
 void
-render_ctache_file(FILE *in_fp,
-                   FILE* out_fp,
-                   struct layout *layouts,
-                   int num_layouts,
-                   ctache_data_t *file_data);
+render_ctache_string(const char *content,
+                     size_t content_len,
+                     FILE *out_fp,
+                     struct layout *layouts,
+                     int num_layouts,
+                     ctache_data_t *file_data);
 
-void
-render_markdown(FILE *in_fp, const char *file_name, char **html_file_name_ptr);
+bool
+template_references(const char *template,
+                    size_t template_len,
+                    const char *name);
+
+char
+*render_markdown_string(const char *file_name,
+                        const char *str,
+                        size_t str_len,
+                        size_t *html_len_ptr);
 
 #endif /* RENDER_H */
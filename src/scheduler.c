@@ -0,0 +1,179 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Copyright (c) 2026 David Jackson
+ */
+
+#include "config.h"
+
+#include "scheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+struct sched_job {
+    struct sched_task *task;
+    void *arg;
+};
+
+static void
+scheduler_submit_task(struct sched_task *task);
+
+/* Release the tasks that were waiting on task. The mutex must be held. */
+static void
+scheduler_task_finished(struct sched_task *task)
+{
+    int i;
+    for (i = 0; i < task->num_dependents; i++) {
+        struct sched_task *dependent = task->dependents[i];
+        dependent->num_unmet_deps--;
+        if (dependent->num_unmet_deps == 0) {
+            scheduler_submit_task(dependent);
+        }
+    }
+}
+
+/*
+ * Run one job of a task. The last job of a task to finish releases the tasks
+ * that depend on it; they are submitted before this job counts as finished so
+ * that the pool never looks idle while there is still work to be scheduled.
+ */
+static void
+*sched_job_run(void *job_ptr)
+{
+    struct sched_job *job = (struct sched_job *) job_ptr;
+    struct sched_task *task = job->task;
+    struct scheduler *scheduler = task->scheduler;
+
+    task->func(job->arg);
+    free(job);
+
+    pthread_mutex_lock(&(scheduler->mutex));
+    task->num_unfinished_jobs--;
+    if (task->num_unfinished_jobs == 0) {
+        scheduler_task_finished(task);
+    }
+    pthread_mutex_unlock(&(scheduler->mutex));
+
+    return NULL;
+}
+
+/* Queue every job of a task on the pool. The mutex must be held. */
+static void
+scheduler_submit_task(struct sched_task *task)
+{
+    int i;
+    task->submitted = true;
+    if (task->num_jobs == 0) {
+        scheduler_task_finished(task);
+        return;
+    }
+    for (i = 0; i < task->num_jobs; i++) {
+        struct sched_job *job = malloc(sizeof(struct sched_job));
+        if (job == NULL) {
+            fprintf(stderr, "ERROR: Could not malloc() for scheduler job\n");
+            abort();
+        }
+        job->task = task;
+        job->arg = task->args[i];
+        thread_pool_submit(task->scheduler->pool, sched_job_run, job);
+    }
+}
+
+void
+scheduler_init(struct scheduler *scheduler, struct thread_pool *pool)
+{
+    scheduler->pool = pool;
+    scheduler->tasks = NULL;
+    pthread_mutex_init(&(scheduler->mutex), NULL);
+}
+
+struct sched_task
+*scheduler_add_task(struct scheduler *scheduler,
+                    void *(*func)(void *),
+                    void **args,
+                    int num_jobs)
+{
+    struct sched_task *task = malloc(sizeof(struct sched_task));
+    if (task == NULL) {
+        fprintf(stderr, "ERROR: Could not malloc() for scheduler task\n");
+        abort();
+    }
+    task->func = func;
+    task->args = args;
+    task->num_jobs = num_jobs;
+    task->num_unfinished_jobs = num_jobs;
+    task->num_unmet_deps = 0;
+    task->submitted = false;
+    task->dependents = NULL;
+    task->num_dependents = 0;
+    task->scheduler = scheduler;
+    task->next = scheduler->tasks;
+    scheduler->tasks = task;
+    return task;
+}
+
+/* Make task wait for every job of dep to finish before it starts */
+void
+scheduler_add_dependency(struct sched_task *task, struct sched_task *dep)
+{
+    size_t size = sizeof(struct sched_task *) * (dep->num_dependents + 1);
+    dep->dependents = realloc(dep->dependents, size);
+    if (dep->dependents == NULL) {
+        fprintf(stderr, "ERROR: Could not realloc() for task dependents\n");
+        abort();
+    }
+    dep->dependents[dep->num_dependents] = task;
+    dep->num_dependents++;
+    task->num_unmet_deps++;
+}
+
+/*
+ * Start every task that has no dependencies, in the order in which the tasks
+ * were added, then wait until every task has run. A task with no jobs
+ * finishes as it is submitted, which can submit the tasks after it that were
+ * only waiting on it, so those are not submitted again.
+ */
+void
+scheduler_run(struct scheduler *scheduler)
+{
+    struct sched_task *ordered = NULL;
+    struct sched_task *task;
+    struct sched_task *next;
+
+    pthread_mutex_lock(&(scheduler->mutex));
+
+    /* The task list is kept newest-first, so reverse it to get added order */
+    for (task = scheduler->tasks; task != NULL; task = next) {
+        next = task->next;
+        task->next = ordered;
+        ordered = task;
+    }
+    scheduler->tasks = ordered;
+
+    for (task = scheduler->tasks; task != NULL; task = task->next) {
+        if (task->num_unmet_deps == 0 && !task->submitted) {
+            scheduler_submit_task(task);
+        }
+    }
+    pthread_mutex_unlock(&(scheduler->mutex));
+
+    thread_pool_wait(scheduler->pool);
+}
+
+void
+scheduler_destroy(struct scheduler *scheduler)
+{
+    struct sched_task *task = scheduler->tasks;
+    struct sched_task *next;
+    while (task != NULL) {
+        next = task->next;
+        free(task->dependents);
+        free(task);
+        task = next;
+    }
+    pthread_mutex_destroy(&(scheduler->mutex));
+}
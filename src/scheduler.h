@@ -0,0 +1,60 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Copyright (c) 2026 David Jackson
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "thread_pool.h"
+#include <pthread.h>
+#include <stdbool.h>
+
+/*
+ * A task is a function that is run num_jobs times on the thread pool, once for
+ * each of its arguments. A task only starts once every task it depends on has
+ * finished all of its jobs.
+ */
+struct sched_task {
+    void *(*func)(void *);
+    void **args;
+    int num_jobs;
+    int num_unfinished_jobs;
+    int num_unmet_deps;
+    bool submitted; /* Its jobs have been queued on the pool */
+    struct sched_task **dependents;
+    int num_dependents;
+    struct scheduler *scheduler;
+    struct sched_task *next;
+};
+
+struct scheduler {
+    struct thread_pool *pool;
+    struct sched_task *tasks;
+    pthread_mutex_t mutex;
+};
+
+void
+scheduler_init(struct scheduler *scheduler, struct thread_pool *pool);
+
+struct sched_task
+*scheduler_add_task(struct scheduler *scheduler,
+                    void *(*func)(void *),
+                    void **args,
+                    int num_jobs);
+
+void
+scheduler_add_dependency(struct sched_task *task, struct sched_task *dep);
+
+void
+scheduler_run(struct scheduler *scheduler);
+
+void
+scheduler_destroy(struct scheduler *scheduler);
+
+#endif /* SCHEDULER_H */
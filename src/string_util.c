@@ -22,7 +22,7 @@ is_whitespace(char ch)
 }
 
 char
-*string_trim(const char *str)
+*string_trim(const char *str, struct arena *arena)
 {
     char *trimmed_str;
     size_t trimmed_len;
@@ -58,7 +58,7 @@ char
         return NULL;
     }
     trimmed_len = str_len - preceding_whitespace_len - trailing_whitespace_len;
-    trimmed_str = malloc(trimmed_len + 1);
+    trimmed_str = arena_alloc(arena, trimmed_len + 1);
     memset(trimmed_str, 0, trimmed_len + 1);
     for (i = begin_index; i < begin_index + trimmed_len; i++) {
         ch = str[i];
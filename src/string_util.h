@@ -13,9 +13,10 @@
 
 #include <stdbool.h>
 #include <stdarg.h>
+#include "arena.h"
 
 char
-*string_trim(const char *str);
+*string_trim(const char *str, struct arena *arena);
 
 bool
 string_matches_any(const char *str, int num_possible_matches, ...);
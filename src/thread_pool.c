@@ -0,0 +1,140 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Copyright (c) 2026 David Jackson
+ */
+
+#include "config.h"
+
+#include "thread_pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+static void
+*thread_pool_worker(void *pool_ptr)
+{
+    struct thread_pool *pool = (struct thread_pool *) pool_ptr;
+    struct thread_pool_job *job;
+
+    pthread_mutex_lock(&(pool->mutex));
+    while (1) {
+        while (pool->head == NULL && !pool->shutting_down) {
+            pthread_cond_wait(&(pool->job_available), &(pool->mutex));
+        }
+        if (pool->head == NULL && pool->shutting_down) {
+            break;
+        }
+
+        job = pool->head;
+        pool->head = job->next;
+        if (pool->head == NULL) {
+            pool->tail = NULL;
+        }
+        pthread_mutex_unlock(&(pool->mutex));
+
+        job->func(job->arg);
+        free(job);
+
+        pthread_mutex_lock(&(pool->mutex));
+        pool->num_unfinished--;
+        if (pool->num_unfinished == 0) {
+            pthread_cond_broadcast(&(pool->jobs_finished));
+        }
+    }
+    pthread_mutex_unlock(&(pool->mutex));
+
+    return NULL;
+}
+
+struct thread_pool
+*thread_pool_create(int num_threads)
+{
+    struct thread_pool *pool = malloc(sizeof(struct thread_pool));
+    if (pool == NULL) {
+        fprintf(stderr, "ERROR: Could not malloc() for thread pool\n");
+        abort();
+    }
+    pool->threads = malloc(sizeof(pthread_t) * num_threads);
+    if (pool->threads == NULL) {
+        fprintf(stderr, "ERROR: Could not malloc() for thread pool\n");
+        abort();
+    }
+    pool->num_threads = num_threads;
+    pool->head = NULL;
+    pool->tail = NULL;
+    pool->num_unfinished = 0;
+    pool->shutting_down = false;
+    pthread_mutex_init(&(pool->mutex), NULL);
+    pthread_cond_init(&(pool->job_available), NULL);
+    pthread_cond_init(&(pool->jobs_finished), NULL);
+
+    int i;
+    for (i = 0; i < num_threads; i++) {
+        pthread_create(&(pool->threads[i]), NULL, thread_pool_worker, pool);
+    }
+
+    return pool;
+}
+
+void
+thread_pool_submit(struct thread_pool *pool,
+                   void *(*func)(void *),
+                   void *arg)
+{
+    struct thread_pool_job *job = malloc(sizeof(struct thread_pool_job));
+    if (job == NULL) {
+        fprintf(stderr, "ERROR: Could not malloc() for thread pool job\n");
+        abort();
+    }
+    job->func = func;
+    job->arg = arg;
+    job->next = NULL;
+
+    pthread_mutex_lock(&(pool->mutex));
+    if (pool->tail == NULL) {
+        pool->head = job;
+    } else {
+        pool->tail->next = job;
+    }
+    pool->tail = job;
+    pool->num_unfinished++;
+    pthread_cond_signal(&(pool->job_available));
+    pthread_mutex_unlock(&(pool->mutex));
+}
+
+/* Block until every job submitted so far has finished running */
+void
+thread_pool_wait(struct thread_pool *pool)
+{
+    pthread_mutex_lock(&(pool->mutex));
+    while (pool->num_unfinished > 0) {
+        pthread_cond_wait(&(pool->jobs_finished), &(pool->mutex));
+    }
+    pthread_mutex_unlock(&(pool->mutex));
+}
+
+/* Finish any remaining jobs, then stop and free the workers */
+void
+thread_pool_destroy(struct thread_pool *pool)
+{
+    pthread_mutex_lock(&(pool->mutex));
+    pool->shutting_down = true;
+    pthread_cond_broadcast(&(pool->job_available));
+    pthread_mutex_unlock(&(pool->mutex));
+
+    int i;
+    for (i = 0; i < pool->num_threads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&(pool->jobs_finished));
+    pthread_cond_destroy(&(pool->job_available));
+    pthread_mutex_destroy(&(pool->mutex));
+    free(pool->threads);
+    free(pool);
+}
@@ -0,0 +1,53 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Copyright (c) 2026 David Jackson
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <pthread.h>
+#include <stdbool.h>
+
+struct thread_pool_job {
+    void *(*func)(void *);
+    void *arg;
+    struct thread_pool_job *next;
+};
+
+/*
+ * A fixed set of worker threads that live for the whole build. Jobs are run in
+ * the order in which they are submitted.
+ */
+struct thread_pool {
+    pthread_t *threads;
+    int num_threads;
+    struct thread_pool_job *head;
+    struct thread_pool_job *tail;
+    int num_unfinished; /* Jobs that are queued or still running */
+    bool shutting_down;
+    pthread_mutex_t mutex;
+    pthread_cond_t job_available;
+    pthread_cond_t jobs_finished;
+};
+
+struct thread_pool
+*thread_pool_create(int num_threads);
+
+void
+thread_pool_submit(struct thread_pool *pool,
+                   void *(*func)(void *),
+                   void *arg);
+
+void
+thread_pool_wait(struct thread_pool *pool);
+
+void
+thread_pool_destroy(struct thread_pool *pool);
+
+#endif /* THREAD_POOL_H */
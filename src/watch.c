@@ -0,0 +1,274 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Copyright (c) 2026 David Jackson
+ */
+
+#include "config.h"
+
+#include "common.h"
+#include "watch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#include <poll.h>
+#endif /* HAVE_SYS_INOTIFY_H */
+
+#define LAYOUTS_DIR_NAME "_layouts"
+#define POSTS_DIR_NAME "_posts"
+#define DEFAULT_DIRS_BUFSIZE 64
+#define EVENTS_BUFSIZE 65536
+#define SETTLE_MS 50 /* How long to wait for more changes before rebuilding */
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM \
+                    | IN_MOVED_TO | IN_DELETE_SELF)
+
+static bool
+is_special_dir(const char *name)
+{
+    return strcmp(name, LAYOUTS_DIR_NAME) == 0
+        || strcmp(name, POSTS_DIR_NAME) == 0;
+}
+
+/*
+ * Watch a directory and everything under it, skipping the same files and
+ * directories that the build skips: those starting with '_' or '.'.
+ */
+static void
+watch_add_tree(struct watch *watch, const char *dir_name)
+{
+    int wd = inotify_add_watch(watch->fd, dir_name, WATCH_MASK | IN_ONLYDIR);
+    if (wd < 0) {
+        return;
+    }
+    if (wd >= watch->dirs_bufsize) {
+        int old_bufsize = watch->dirs_bufsize;
+        while (wd >= watch->dirs_bufsize) {
+            watch->dirs_bufsize *= 2;
+        }
+        watch->dirs = realloc(watch->dirs,
+                              sizeof(char *) * watch->dirs_bufsize);
+        if (watch->dirs == NULL) {
+            fprintf(stderr, "ERROR: Could not realloc() for watch\n");
+            abort();
+        }
+        memset(watch->dirs + old_bufsize,
+               0,
+               sizeof(char *) * (watch->dirs_bufsize - old_bufsize));
+    }
+    free(watch->dirs[wd]);
+    watch->dirs[wd] = strdup(dir_name);
+
+    DIR *dir = opendir(dir_name);
+    if (dir == NULL) {
+        return;
+    }
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
+        char *name = de->d_name;
+        if (name[0] == '_' || name[0] == '.') {
+            continue;
+        }
+        char *path;
+        asprintf(&path, "%s/%s", dir_name, name);
+        struct stat statbuf;
+        if (stat(path, &statbuf) == 0 && S_ISDIR(statbuf.st_mode)) {
+            watch_add_tree(watch, path);
+        }
+        free(path);
+    }
+    closedir(dir);
+}
+
+bool
+watch_init(struct watch *watch, const char *curr_dir_name)
+{
+    watch->fd = inotify_init1(IN_CLOEXEC);
+    if (watch->fd < 0) {
+        perror("inotify_init1");
+        return false;
+    }
+    watch->dirs_bufsize = DEFAULT_DIRS_BUFSIZE;
+    watch->dirs = calloc(watch->dirs_bufsize, sizeof(char *));
+    watch->root = strdup(curr_dir_name);
+
+    watch_add_tree(watch, curr_dir_name);
+    watch_add_tree(watch, LAYOUTS_DIR_NAME);
+    watch_add_tree(watch, POSTS_DIR_NAME);
+    return true;
+}
+
+/* Work out what a single event touched, watching any new directory */
+static int
+watch_handle_event(struct watch *watch, struct inotify_event *event)
+{
+    if (event->mask & IN_Q_OVERFLOW) {
+        /* Events were lost, so anything might have changed */
+        return WATCH_SOURCES | WATCH_LAYOUTS | WATCH_CONFIG;
+    }
+    if (event->wd < 0 || event->wd >= watch->dirs_bufsize) {
+        return 0;
+    }
+    const char *dir_name = watch->dirs[event->wd];
+    if (event->mask & IN_IGNORED) {
+        /* The directory is gone */
+        free(watch->dirs[event->wd]);
+        watch->dirs[event->wd] = NULL;
+        return 0;
+    }
+    if (dir_name == NULL || event->len == 0) {
+        return 0;
+    }
+
+    /* Skip editor swap and backup files */
+    const char *name = event->name;
+    size_t name_len = strlen(name);
+    if (name[0] == '.' || name_len == 0 || name[name_len - 1] == '~') {
+        return 0;
+    }
+
+    bool is_root = strcmp(dir_name, watch->root) == 0;
+    bool is_new_dir = (event->mask & (IN_CREATE | IN_MOVED_TO))
+        && (event->mask & IN_ISDIR);
+    if (is_root && name[0] == '_') {
+        if (strcmp(name, CONFIG_FILE_NAME) == 0) {
+            return WATCH_CONFIG;
+        } else if (!is_special_dir(name)) {
+            return 0;
+        }
+        if (is_new_dir) {
+            watch_add_tree(watch, name);
+        }
+        return strcmp(name, LAYOUTS_DIR_NAME) == 0
+            ? WATCH_LAYOUTS
+            : WATCH_SOURCES;
+    }
+    if (name[0] == '_') {
+        return 0;
+    }
+
+    if (is_new_dir) {
+        char *path;
+        asprintf(&path, "%s/%s", dir_name, name);
+        watch_add_tree(watch, path);
+        free(path);
+    }
+    return strcmp(dir_name, LAYOUTS_DIR_NAME) == 0
+        ? WATCH_LAYOUTS
+        : WATCH_SOURCES;
+}
+
+/*
+ * Collect changes, waiting up to first_timeout milliseconds for the first one
+ * and settle_timeout for each one after. Returns what the changes touched, or
+ * -1 on error.
+ */
+static int
+watch_collect(struct watch *watch, int first_timeout, int settle_timeout)
+{
+    char *buf = malloc(EVENTS_BUFSIZE);
+    if (buf == NULL) {
+        fprintf(stderr, "ERROR: Could not malloc() for watch events\n");
+        abort();
+    }
+
+    int changes = 0;
+    struct pollfd pollfd;
+    pollfd.fd = watch->fd;
+    pollfd.events = POLLIN;
+    while (1) {
+        int timeout = changes == 0 ? first_timeout : settle_timeout;
+        int retval = poll(&pollfd, 1, timeout);
+        if (retval < 0) {
+            perror("poll");
+            changes = -1;
+            break;
+        } else if (retval == 0) {
+            break;
+        }
+
+        ssize_t len = read(watch->fd, buf, EVENTS_BUFSIZE);
+        if (len <= 0) {
+            perror("read");
+            changes = -1;
+            break;
+        }
+        char *ptr = buf;
+        while (ptr < buf + len) {
+            struct inotify_event *event = (struct inotify_event *) ptr;
+            changes |= watch_handle_event(watch, event);
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    free(buf);
+    return changes;
+}
+
+/*
+ * Block until something changes, then keep collecting changes until there
+ * have been none for a moment, since a single save is often several events.
+ */
+int
+watch_wait(struct watch *watch)
+{
+    return watch_collect(watch, -1, SETTLE_MS);
+}
+
+/* Collect whatever has changed since the last call, without blocking */
+int
+watch_poll(struct watch *watch)
+{
+    return watch_collect(watch, 0, 0);
+}
+
+void
+watch_destroy(struct watch *watch)
+{
+    int i;
+    for (i = 0; i < watch->dirs_bufsize; i++) {
+        free(watch->dirs[i]);
+    }
+    free(watch->dirs);
+    free(watch->root);
+    close(watch->fd);
+}
+
+#else
+
+bool
+watch_init(struct watch *watch, const char *curr_dir_name)
+{
+    fprintf(stderr, "ERROR: Watching is not supported on this platform\n");
+    return false;
+}
+
+int
+watch_wait(struct watch *watch)
+{
+    return -1;
+}
+
+int
+watch_poll(struct watch *watch)
+{
+    return -1;
+}
+
+void
+watch_destroy(struct watch *watch)
+{
+}
+
+#endif /* HAVE_SYS_INOTIFY_H */
@@ -0,0 +1,44 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Copyright (c) 2026 David Jackson
+ */
+
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <stdbool.h>
+
+/* What a batch of changes touched */
+#define WATCH_SOURCES 0x1
+#define WATCH_LAYOUTS 0x2
+#define WATCH_CONFIG 0x4
+
+/*
+ * Watches a site's source tree, its layouts, its posts and its config for
+ * changes. Directories created while watching are watched too.
+ */
+struct watch {
+    int fd;
+    char *root;
+    char **dirs; /* Indexed by watch descriptor */
+    int dirs_bufsize;
+};
+
+bool
+watch_init(struct watch *watch, const char *curr_dir_name);
+
+int
+watch_wait(struct watch *watch);
+
+int
+watch_poll(struct watch *watch);
+
+void
+watch_destroy(struct watch *watch);
+
+#endif /* WATCH_H */
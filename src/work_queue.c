@@ -0,0 +1,46 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Copyright (c) 2026 David Jackson
+ */
+
+#include "config.h"
+
+#include "work_queue.h"
+#include <stdlib.h>
+#include <pthread.h>
+
+void
+work_queue_init(struct work_queue *queue, void **items, int num_items)
+{
+    queue->items = items;
+    queue->num_items = num_items;
+    queue->next_index = 0;
+    pthread_mutex_init(&(queue->mutex), NULL);
+}
+
+/* Take the next item off of the queue, returns NULL once it is empty */
+void
+*work_queue_next(struct work_queue *queue)
+{
+    void *item = NULL;
+
+    pthread_mutex_lock(&(queue->mutex));
+    if (queue->next_index < queue->num_items) {
+        item = queue->items[queue->next_index];
+        queue->next_index++;
+    }
+    pthread_mutex_unlock(&(queue->mutex));
+
+    return item;
+}
+
+void
+work_queue_destroy(struct work_queue *queue)
+{
+    pthread_mutex_destroy(&(queue->mutex));
+}
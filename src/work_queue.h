@@ -0,0 +1,37 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Copyright (c) 2026 David Jackson
+ */
+
+#ifndef WORK_QUEUE_H
+#define WORK_QUEUE_H
+
+#include <pthread.h>
+
+/*
+ * A queue of work items shared by all of the workers of a generation pass.
+ * Each worker takes the next item from a shared cursor so that no worker sits
+ * idle while another still has a backlog of large files.
+ */
+struct work_queue {
+    void **items;
+    int num_items;
+    int next_index;
+    pthread_mutex_t mutex;
+};
+
+void
+work_queue_init(struct work_queue *queue, void **items, int num_items);
+
+void
+*work_queue_next(struct work_queue *queue);
+
+void
+work_queue_destroy(struct work_queue *queue);
+
+#endif /* WORK_QUEUE_H */
@@ -0,0 +1,276 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Copyright (c) 2026 David Jackson
+ */
+
+#include "config.h"
+
+#include "workers.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <unistd.h>
+#ifdef HAVE_SCHED_GETAFFINITY
+#include <sched.h>
+#endif /* HAVE_SCHED_GETAFFINITY */
+
+#define PROC_SELF_CGROUP "/proc/self/cgroup"
+#define CGROUP_LINE_BUFSIZE (PATH_MAX + 256)
+#define CGROUP_FILE_NAME_BUFSIZE (PATH_MAX + 32)
+#define IO_WORKERS_PER_CPU 2
+#define MIN_IO_WORKERS 2
+#define MAX_IO_WORKERS 64
+
+/* The number of CPUs this process is allowed to run on */
+static int
+affinity_cpus(void)
+{
+    int num_cpus = -1;
+#ifdef HAVE_SCHED_GETAFFINITY
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &cpu_set) == 0) {
+        num_cpus = CPU_COUNT(&cpu_set);
+    }
+#endif /* HAVE_SCHED_GETAFFINITY */
+    if (num_cpus < 1) {
+        num_cpus = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    return num_cpus;
+}
+
+static long
+read_long_from_file(const char *file_name)
+{
+    long value = -1;
+    FILE *fp = fopen(file_name, "r");
+    if (fp != NULL) {
+        if (fscanf(fp, "%ld", &value) != 1) {
+            value = -1;
+        }
+        fclose(fp);
+    }
+    return value;
+}
+
+/* Where the cgroup v2 hierarchy may be mounted, pure or hybrid */
+static const char *cgroup2_mounts[] = {
+    "/sys/fs/cgroup",
+    "/sys/fs/cgroup/unified",
+    NULL
+};
+
+/* Where the cgroup v1 cpu controller may be mounted */
+static const char *cgroup1_cpu_mounts[] = {
+    "/sys/fs/cgroup/cpu",
+    "/sys/fs/cgroup/cpu,cpuacct",
+    NULL
+};
+
+static int
+quota_cpus(long quota, long period)
+{
+    if (quota <= 0 || period <= 0) {
+        return -1;
+    }
+    return (int) ((quota + period - 1) / period);
+}
+
+/* A cgroup v2 cpu.max holds "max <period>" or "<quota> <period>" */
+static int
+cgroup2_dir_quota_cpus(const char *dir)
+{
+    char file_name[CGROUP_FILE_NAME_BUFSIZE];
+    long quota = -1;
+    long period = -1;
+    snprintf(file_name, CGROUP_FILE_NAME_BUFSIZE, "%s/cpu.max", dir);
+    FILE *fp = fopen(file_name, "r");
+    if (fp != NULL) {
+        char quota_str[32];
+        if (fscanf(fp, "%31s %ld", quota_str, &period) == 2) {
+            quota = strtol(quota_str, NULL, 10);
+            if (quota == 0) {
+                quota = -1; /* "max" */
+            }
+        }
+        fclose(fp);
+    }
+    return quota_cpus(quota, period);
+}
+
+static int
+cgroup1_dir_quota_cpus(const char *dir)
+{
+    char file_name[CGROUP_FILE_NAME_BUFSIZE];
+    snprintf(file_name, CGROUP_FILE_NAME_BUFSIZE, "%s/cpu.cfs_quota_us", dir);
+    long quota = read_long_from_file(file_name);
+    snprintf(file_name, CGROUP_FILE_NAME_BUFSIZE, "%s/cpu.cfs_period_us", dir);
+    long period = read_long_from_file(file_name);
+    return quota_cpus(quota, period);
+}
+
+/*
+ * The smallest quota set on the cgroup at path below mount or on any of its
+ * ancestors, since each of them limits the process, or -1 if there is none.
+ * A path that is not visible from here, e.g. outside a cgroup namespace, is
+ * walked up until it is.
+ */
+static int
+cgroup_hierarchy_quota_cpus(const char *mount, const char *path, bool is_v2)
+{
+    char dir[PATH_MAX];
+    size_t mount_len = strlen(mount);
+    if (snprintf(dir, PATH_MAX, "%s%s", mount, path) >= PATH_MAX) {
+        return -1;
+    }
+    size_t dir_len = strlen(dir);
+    while (dir_len > mount_len && dir[dir_len - 1] == '/') {
+        dir[--dir_len] = '\0';
+    }
+
+    int min_cpus = -1;
+    while (true) {
+        int cpus = is_v2 ? cgroup2_dir_quota_cpus(dir)
+                         : cgroup1_dir_quota_cpus(dir);
+        if (cpus > 0 && (min_cpus < 0 || cpus < min_cpus)) {
+            min_cpus = cpus;
+        }
+        if (dir_len <= mount_len) {
+            break;
+        }
+        while (dir_len > mount_len && dir[dir_len - 1] != '/') {
+            dir_len--;
+        }
+        if (dir_len > mount_len) {
+            dir_len--; /* The slash */
+        }
+        dir[dir_len] = '\0';
+    }
+    return min_cpus;
+}
+
+static int
+cgroup_mounts_quota_cpus(const char **mounts, const char *path, bool is_v2)
+{
+    int min_cpus = -1;
+    int i;
+    for (i = 0; mounts[i] != NULL; i++) {
+        int cpus = cgroup_hierarchy_quota_cpus(mounts[i], path, is_v2);
+        if (cpus > 0 && (min_cpus < 0 || cpus < min_cpus)) {
+            min_cpus = cpus;
+        }
+    }
+    return min_cpus;
+}
+
+/* Whether a comma-separated list of cgroup v1 controllers includes cpu */
+static bool
+has_cpu_controller(const char *controllers, size_t controllers_len)
+{
+    const char *end = controllers + controllers_len;
+    const char *start = controllers;
+    while (start < end) {
+        const char *comma = memchr(start, ',', end - start);
+        if (comma == NULL) {
+            comma = end;
+        }
+        if (comma - start == 3 && strncmp(start, "cpu", 3) == 0) {
+            return true;
+        }
+        start = comma + 1;
+    }
+    return false;
+}
+
+/*
+ * The number of CPUs worth of time the cgroup CPU quota allows, rounded up, or
+ * -1 if there is no quota. The process's own cgroups are read from
+ * /proc/self/cgroup: "0::<path>" for v2 and "<id>:<controllers>:<path>" for
+ * each v1 hierarchy. Without it, only the quota at the root is seen.
+ */
+static int
+cgroup_quota_cpus(void)
+{
+    FILE *fp = fopen(PROC_SELF_CGROUP, "r");
+    if (fp == NULL) {
+        int cpus = cgroup_mounts_quota_cpus(cgroup2_mounts, "", true);
+        if (cpus < 0) {
+            cpus = cgroup_mounts_quota_cpus(cgroup1_cpu_mounts, "", false);
+        }
+        return cpus;
+    }
+
+    int min_cpus = -1;
+    char line[CGROUP_LINE_BUFSIZE];
+    while (fgets(line, CGROUP_LINE_BUFSIZE, fp) != NULL) {
+        line[strcspn(line, "\n")] = '\0';
+        char *controllers = strchr(line, ':');
+        if (controllers == NULL) {
+            continue;
+        }
+        controllers++;
+        char *path = strchr(controllers, ':');
+        if (path == NULL) {
+            continue;
+        }
+        size_t controllers_len = path - controllers;
+        path++;
+
+        int cpus = -1;
+        if (strncmp(line, "0:", 2) == 0 && controllers_len == 0) {
+            cpus = cgroup_mounts_quota_cpus(cgroup2_mounts, path, true);
+        } else if (has_cpu_controller(controllers, controllers_len)) {
+            cpus = cgroup_mounts_quota_cpus(cgroup1_cpu_mounts, path, false);
+        }
+        if (cpus > 0 && (min_cpus < 0 || cpus < min_cpus)) {
+            min_cpus = cpus;
+        }
+    }
+    fclose(fp);
+    return min_cpus;
+}
+
+/*
+ * The number of CPUs that are actually available to the process, taking into
+ * account both its CPU affinity and any cgroup CPU quota.
+ */
+int
+workers_available_cpus(void)
+{
+    int num_cpus = affinity_cpus();
+    int quota_cpus = cgroup_quota_cpus();
+    if (quota_cpus > 0 && quota_cpus < num_cpus) {
+        num_cpus = quota_cpus;
+    }
+    if (num_cpus < 1) {
+        num_cpus = 1;
+    }
+    return num_cpus;
+}
+
+/* Workers for CPU-bound work, e.g. rendering, one per available CPU */
+int
+workers_cpu_bound(void)
+{
+    return workers_available_cpus();
+}
+
+/* Workers for I/O-bound work, which spend most of their time blocked */
+int
+workers_io_bound(void)
+{
+    int num_workers = workers_available_cpus() * IO_WORKERS_PER_CPU;
+    if (num_workers < MIN_IO_WORKERS) {
+        num_workers = MIN_IO_WORKERS;
+    } else if (num_workers > MAX_IO_WORKERS) {
+        num_workers = MAX_IO_WORKERS;
+    }
+    return num_workers;
+}
@@ -0,0 +1,23 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Copyright (c) 2026 David Jackson
+ */
+
+#ifndef WORKERS_H
+#define WORKERS_H
+
+int
+workers_available_cpus(void);
+
+int
+workers_cpu_bound(void);
+
+int
+workers_io_bound(void);
+
+#endif /* WORKERS_H */
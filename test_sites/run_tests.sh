@@ -1,6 +1,9 @@
 #!/bin/sh
 
 CYTO="../src/cyto"
+# Nothing but the cache test may write to a render cache
+CYTO_CACHE_DIR=none
+export CYTO_CACHE_DIR
 SITE_DIR='_site'
 EXPECTED='_expected'
 
@@ -90,6 +93,10 @@ run_test() {
 
 	test_directory "$test_name" "./$SITE_DIR"
 
+	# Building again over an up-to-date site must leave it the same
+	../$CYTO generate
+	test_directory "$test_name" "./$SITE_DIR"
+
 	../$CYTO clean
 
 	if [ "$?" -eq 0 ]
@@ -100,11 +107,147 @@ run_test() {
 	fi
 }
 
+# Copy a test site into a scratch directory, leaving out anything built
+scratch_site() {
+	scratch_dir=`mktemp -d`
+	cp -R "$1/." "$scratch_dir"
+	rm -rf "$scratch_dir/$SITE_DIR" "$scratch_dir/$SITE_DIR.staging" \
+		"$scratch_dir/$EXPECTED"
+	echo "$scratch_dir"
+}
+
+# The site as built so far must be the same as a build of it from scratch
+check_fresh() {
+	step="$1"
+	fresh_dir=`scratch_site .`
+	(cd "$fresh_dir" && "$CYTO_PATH" generate)
+	same=1
+	diff -r -x '.cyto-*' -x feed.xml "$fresh_dir/$SITE_DIR" "$SITE_DIR" \
+		|| same=0
+	if [ -f "$SITE_DIR/feed.xml" ]
+	then
+		sed -e '/<updated>/d' "$SITE_DIR/feed.xml" > feed.actual
+		sed -e '/<updated>/d' "$fresh_dir/$SITE_DIR/feed.xml" > feed.fresh
+		diff feed.fresh feed.actual || same=0
+		rm -f feed.fresh feed.actual
+	fi
+	rm -rf "$fresh_dir"
+	if [ "$same" -ne 1 ]
+	then
+		printf "FAIL: Not the same as a fresh build: $step\n"
+		exit 1
+	fi
+}
+
+# Each change is built over the site as the last step left it
+run_incremental_test() {
+	printf "Running incremental builds... "
+	"$CYTO_PATH" generate && check_fresh "first build"
+
+	echo '<!-- edited -->' >> _layouts/post.html
+	"$CYTO_PATH" generate && check_fresh "edit a layout"
+
+	rm about/index.md
+	"$CYTO_PATH" generate && check_fresh "delete a page"
+
+	# A page that only reaches the posts through its layout's layout
+	printf '%s\n' '---' 'layout: default' '---' \
+		'{{^ posts}}None{{/posts}}{{#posts}}{{title}}{{/posts}}' \
+		'{{>content}}' > _layouts/listing.html
+	printf '%s\n' '---' 'layout: listing' '---' '{{>content}}' \
+		> _layouts/archive.html
+	mkdir archive
+	printf '%s\n' '---' 'layout: archive' 'title: Archive' '---' 'All' \
+		> archive/index.html
+	"$CYTO_PATH" generate && check_fresh "add a page listing the posts"
+
+	printf '%s\n' '---' 'layout: post' 'title: Added' '---' 'Added' \
+		> _posts/2019-01-01-added.md
+	"$CYTO_PATH" generate && check_fresh "add a post"
+
+	rm _posts/2019-01-01-added.md
+	"$CYTO_PATH" generate && check_fresh "delete a post"
+
+	mv _posts/2018-06-11-test-three.md _posts/2018-06-11-test-three.mkd
+	"$CYTO_PATH" generate && check_fresh "rename a post's extension"
+	printf "PASS\n"
+}
+
+# Every way of building the site must give the same site as the default
+run_modes_test() {
+	printf "Running build modes... "
+	printf 'not text' > image.png
+
+	"$CYTO_PATH" -p generate && check_fresh "-p"
+	rm -rf "$SITE_DIR"
+
+	for shard in 1/2 2/2
+	do
+		"$CYTO_PATH" --shard "$shard" generate || exit 1
+	done
+	"$CYTO_PATH" merge && check_fresh "--shard and merge"
+	rm -rf "$SITE_DIR"
+
+	"$CYTO_PATH" --staged generate && check_fresh "--staged"
+	"$CYTO_PATH" --staged generate && check_fresh "--staged again"
+	echo 'extra' > extra.txt
+	"$CYTO_PATH" --staged generate && check_fresh "--staged, adding a file"
+	rm extra.txt
+	"$CYTO_PATH" --staged generate && check_fresh "--staged, deleting it"
+	# Only the deletion is reported, relative to the site that was published
+	if [ `grep -c . "$SITE_DIR/.cyto-changes"` -ne 2 ] \
+		|| ! grep -q '^deleted.*extra.txt$' "$SITE_DIR/.cyto-changes"
+	then
+		printf "FAIL: Wrong changes for a staged build\n"
+		cat "$SITE_DIR/.cyto-changes"
+		exit 1
+	fi
+	rm -rf "$SITE_DIR" "$SITE_DIR.staging"
+
+	cache_dir=`mktemp -d`
+	"$CYTO_PATH" -C "$cache_dir" generate && check_fresh "-C"
+	rm -rf "$SITE_DIR"
+	"$CYTO_PATH" -C "$cache_dir" generate && check_fresh "-C, from the cache"
+	# An entry made from anything else is not used, even under its name
+	for entry in "$cache_dir"/*/*
+	do
+		sed -e '1s/^cyto-cache /cyto-cache-other /' -e '2,$s/./x/g' \
+			"$entry" > "$entry.new" && mv "$entry.new" "$entry"
+	done
+	rm -rf "$SITE_DIR"
+	"$CYTO_PATH" -C "$cache_dir" generate \
+		&& check_fresh "-C, with entries that do not match"
+	"$CYTO_PATH" -C "$cache_dir" clean
+	if [ -d "$cache_dir" ]
+	then
+		printf "FAIL: Render cache left after clean\n"
+		exit 1
+	fi
+
+	for mode in hardlink symlink copy
+	do
+		"$CYTO_PATH" --assets=$mode generate \
+			&& check_fresh "--assets=$mode"
+
+		# An asset edited in place is still the one its link points to
+		printf ' edited' >> image.png
+		"$CYTO_PATH" --assets=$mode generate \
+			&& check_fresh "--assets=$mode, editing an asset"
+		if ! grep -q '^modified.*image.png$' "$SITE_DIR/.cyto-changes"
+		then
+			printf "FAIL: Edited asset not reported for $mode\n"
+			exit 1
+		fi
+	done
+	printf "PASS\n"
+}
+
 if [ ! -f "$CYTO" ]
 then
 	echo 'ERROR: cyto not built'
 	exit 1
 fi
+CYTO_PATH="`pwd`/$CYTO"
 
 fail_count=0
 for dir in `find . -type 'd' -name '*_test' | sort -n`
@@ -116,8 +259,23 @@ do
 
 	if [ "$?" -ne 0 ]
 	then
-		fail_count=`dc -e "$fail_count 1 + p"`
+		fail_count=$((fail_count + 1))
+	fi
+done
+
+for test_func in run_incremental_test run_modes_test
+do
+	scratch_dir=`scratch_site config_data_test`
+	(
+		cd "$scratch_dir"
+		$test_func
+	)
+
+	if [ "$?" -ne 0 ]
+	then
+		fail_count=$((fail_count + 1))
 	fi
+	rm -rf "$scratch_dir"
 done
 
 echo '----------'
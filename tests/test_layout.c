@@ -10,6 +10,7 @@
 
 #include "layout.h"
 #include <stdlib.h>
+#include <string.h>
 #include <astrounit.h>
 
 ASTRO_TEST_BEGIN(test_recursive_layouts)
@@ -25,6 +26,26 @@ ASTRO_TEST_BEGIN(test_recursive_layouts)
 }
 ASTRO_TEST_END
 
+ASTRO_TEST_BEGIN(test_layout_graph)
+{
+    int num_layouts;
+    struct layout *layouts;
+    layouts = get_layouts(&num_layouts);
+    int i;
+    for (i = 0; i < num_layouts; i++) {
+        if (strcmp(layouts[i].name, "post") == 0) {
+            assert_str_eq("default", layouts[i].parent, "Wrong parent layout");
+        }
+    }
+    uint64_t post_hash = layout_dependency_hash(layouts, num_layouts, "post");
+    uint64_t default_hash = layout_dependency_hash(layouts,
+                                                   num_layouts,
+                                                   "default");
+    assert_int_eq(1, post_hash != default_hash, "Layout hashes are the same");
+    layouts_destroy(layouts, num_layouts);
+}
+ASTRO_TEST_END
+
 int
 main(void)
 {
@@ -33,6 +54,7 @@ main(void)
 
     suite = astro_suite_create();
     astro_suite_add_test(suite, test_recursive_layouts, NULL);
+    astro_suite_add_test(suite, test_layout_graph, NULL);
     num_failures = astro_suite_run(suite);
     astro_suite_destroy(suite);
 